@@ -0,0 +1,108 @@
+#include <stdlib.h>
+#include "arena.h"
+
+/**
+        arena.c
+*/
+
+void
+arena_init(struct arena *a) {
+        int i;
+
+        a->chunks = NULL;
+        for (i = 0; i < ARENA_CLASSES; i++)
+                a->free[i] = NULL;
+        a->mallocs = 0;
+        a->allocs = 0;
+        a->frees = 0;
+        a->bytes = 0;
+}
+
+void
+arena_destroy(struct arena *a) {
+        struct arena_chunk *c = a->chunks;
+
+        while (c != NULL) {
+                struct arena_chunk *next = c->next;
+                free(c);
+                c = next;
+        }
+
+        arena_init(a);
+}
+
+static int
+arena_class(size_t size) {
+        size_t s = ARENA_MIN_SIZE;
+        int k = 0;
+
+        while (s < size) {
+                s <<= 1;
+                k++;
+        }
+
+        return k;
+}
+
+/* The number of bytes arena_alloc(size) really reserves. */
+size_t
+arena_size(size_t size) {
+        return (size_t) ARENA_MIN_SIZE << arena_class(size);
+}
+
+void *
+arena_alloc(struct arena *a, size_t size) {
+        int k = arena_class(size);
+        size_t s = (size_t) ARENA_MIN_SIZE << k;
+        struct arena_chunk *c = a->chunks;
+        void *p;
+
+        a->allocs++;
+
+        if (a->free[k] != NULL) {
+                p = a->free[k];
+                a->free[k] = *(void **) p;
+                return p;
+        }
+
+        if (c == NULL || c->size - c->used < s) {
+                /* Big blocks get a chunk of their own. */
+                size_t chunk_size = s > ARENA_CHUNK_SIZE / 2 ? s : ARENA_CHUNK_SIZE;
+                struct arena_chunk *n = malloc(sizeof(struct arena_chunk) + chunk_size);
+                if (n == NULL)
+                        return NULL;
+
+                n->used = 0;
+                n->size = chunk_size;
+                a->mallocs++;
+                a->bytes += chunk_size;
+
+                if (c != NULL && chunk_size != ARENA_CHUNK_SIZE) {
+                        /* Keep filling the current chunk. */
+                        n->next = c->next;
+                        c->next = n;
+                } else {
+                        n->next = c;
+                        a->chunks = n;
+                }
+                c = n;
+        }
+
+        p = &c->data[c->used];
+        c->used += s;
+        return p;
+}
+
+/* size must be the one given to arena_alloc(). */
+void
+arena_free(struct arena *a, void *p, size_t size) {
+        int k;
+
+        if (p == NULL)
+                return;
+
+        k = arena_class(size);
+        *(void **) p = a->free[k];
+        a->free[k] = p;
+        a->frees++;
+}
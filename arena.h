@@ -0,0 +1,43 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/**
+        arena.h
+
+        A per-buffer allocator for row storage (chars, render and hl).
+        Requests are rounded up to a power of two size class and carved
+        out of large chunks; freed blocks go to a free list of their
+        class. Everything is released at once with arena_destroy(), in
+        O(chunks).
+*/
+
+#define ARENA_CHUNK_SIZE (256 * 1024)
+#define ARENA_MIN_SIZE 16
+#define ARENA_CLASSES 32
+
+struct arena_chunk {
+        struct arena_chunk *next;
+        size_t used;
+        size_t size;
+        size_t pad;     /* Keeps data 16-byte aligned. */
+        char data[];
+};
+
+struct arena {
+        struct arena_chunk *chunks;     /* The newest first. */
+        void *free[ARENA_CLASSES];
+        long mallocs;   /* Chunks malloc'd. */
+        long allocs;    /* arena_alloc() calls. */
+        long frees;     /* arena_free() calls. */
+        size_t bytes;   /* Total size of the chunks. */
+};
+
+void arena_init(struct arena *a);
+void arena_destroy(struct arena *a);
+size_t arena_size(size_t size);
+void *arena_alloc(struct arena *a, size_t size);
+void arena_free(struct arena *a, void *p, size_t size);
+
+#endif
@@ -47,6 +47,50 @@ create_buffer(int type, int verbose, char *success, int initial_undo_command) {
         return current_buffer;        
 }
 
+/** 
+ * Editing commands call this first. 
+ * return 1 (and tell the user) if the current buffer is read-only.
+ */
+int
+buffer_is_readonly() {
+        if (current_buffer->type != BUFFER_TYPE_READONLY)
+                return 0; 
+
+        editor_set_status_message(READONLY_STATUS_MESSAGE);
+        return 1; 
+}
+
+/* Waits for the saves of all the buffers to end, see editor_save_reap(). */
+void
+buffer_reap_saves() {
+        struct editor_config *current = E; 
+        struct buffer_str *b = current_buffer; 
+
+        while (b != NULL && b->prev != NULL)
+                b = b->prev; 
+
+        for (; b != NULL; b = b->next) {
+                E = &b->E; 
+                editor_save_reap(1); 
+        }
+        E = current; 
+}
+
+/* The editor quits: the edits not saved are not wanted. */
+void
+buffer_drop_journals() {
+        struct buffer_str *b = current_buffer; 
+
+        while (b != NULL && b->prev != NULL)
+                b = b->prev; 
+
+        for (; b != NULL; b = b->next) {
+                if (b->E.journal != NULL)
+                        journal_free(b->E.journal, 0); 
+                b->E.journal = NULL; 
+        }
+}
+
 /** to command.c */
 void
 command_next_buffer() {
@@ -94,12 +138,18 @@ delete_current_buffer() {
                 return; // Cannot delete the only buffer.    
         }
 
+        /* A file still being read is opened first: the job is the opener's until then. */
+        editor_open_pending(); 
+
         // Not so fast: are there any unsaved changes? 
         // Ok, this is a quick and dirty solution for this buffer only.
+        editor_save_reap(1); 
         if (E->dirty) {
                 editor_set_status_message(c->error_status);
                 return; 
         }
+        if (E->journal != NULL)
+                journal_free(E->journal, 0); 
 
         // Free undo_stack.
         u = current_buffer->undo_stack;
@@ -123,6 +173,13 @@ delete_current_buffer() {
                 u = n;
         }
 
+        // Free the rows: their storage is all in the buffer's arena.
+        if (current_buffer->E.loader != NULL)
+                loader_free(current_buffer->E.loader);
+        line_index_free(&current_buffer->E.lines);
+        view_free(&current_buffer->E.view);
+        piece_table_free(&current_buffer->E.text);
+
         if (current_buffer->prev != NULL) {
                 current_buffer->prev->next = current_buffer->next;
                 new_current = current_buffer->prev; /* Prev has priority. */
@@ -34,5 +34,8 @@ struct buffer_str *create_buffer(int type, int verbose, char *success, int init_
 void command_next_buffer(); /* TODO circular. */
 void command_previous_buffer(); /* TODO circular. */
 void delete_current_buffer();
+void buffer_reap_saves();
+void buffer_drop_journals();
+int buffer_is_readonly();
 
 #endif
@@ -0,0 +1,230 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "cache.h"
+
+/**
+        cache.c
+*/
+
+/* The byte size of a sidecar with n checkpoints. */
+static size_t
+cache_size(int64_t n) {
+        return sizeof(struct cache_header) + n * (sizeof(size_t) + 1);
+}
+
+/* FNV-1a; names the sidecar of a path. */
+static uint64_t
+cache_hash(const char *s) {
+        uint64_t h = 14695981039346656037ULL;
+
+        while (*s != '\0') {
+                h ^= (unsigned char) *s++;
+                h *= 1099511628211ULL;
+        }
+
+        return h;
+}
+
+/* Makes dir unless it is there. return 0 ok, -1 not. */
+static int
+cache_mkdir(const char *dir) {
+        return mkdir(dir, 0700) == 0 || errno == EEXIST ? 0 : -1;
+}
+
+/**
+ * Puts the path of the sidecar of filename (an absolute path) to path,
+ * creating the directories on the way if create is set.
+ *
+ * return 0 ok, -1 no cache directory
+ */
+static int
+cache_path(const char *filename, char *path, size_t size, int create) {
+        const char *xdg = getenv("XDG_CACHE_HOME");
+        const char *home = getenv("HOME");
+        char dir[PATH_MAX];
+
+        if (xdg != NULL && *xdg != '\0') {
+                snprintf(dir, sizeof(dir), "%s", xdg);
+        } else if (home != NULL && *home != '\0') {
+                snprintf(dir, sizeof(dir), "%s/.cache", home);
+        } else {
+                return -1;
+        }
+
+        if (create && cache_mkdir(dir) == -1)
+                return -1;
+
+        if (strlen(dir) + sizeof("/kilo") > sizeof(dir))
+                return -1;
+        strcat(dir, "/kilo");
+        if (create && cache_mkdir(dir) == -1)
+                return -1;
+
+        if (snprintf(path, size, "%s/%016llx.lines", dir,
+                (unsigned long long) cache_hash(filename)) >= (int) size)
+                return -1;
+
+        return 0;
+}
+
+/* Fills h for the file st is about, whose text is len bytes. */
+static void
+cache_header_init(struct cache_header *h, struct stat *st, size_t len, int page_lines) {
+        memset(h, 0, sizeof(struct cache_header));
+        memcpy(h->magic, CACHE_MAGIC, sizeof(h->magic));
+        h->checkpoint_size = sizeof(size_t);
+        h->page_lines = page_lines;
+        h->dev = st->st_dev;
+        h->ino = st->st_ino;
+        h->size = st->st_size;
+        h->len = len;
+        h->mtime_sec = st->st_mtim.tv_sec;
+        h->mtime_nsec = st->st_mtim.tv_nsec;
+}
+
+/**
+ * Do the checkpoints of h (which follow it) fit the text: one per page
+ * of numrows, the first at 0, and each further on than the last but
+ * still in the text? A sidecar that is cut or overwritten is not read past.
+ */
+static int
+cache_checkpoints_ok(struct cache_header *h) {
+        size_t *checkpoints = (size_t *) (h + 1);
+        int64_t k;
+
+        if (h->numrows > INT_MAX
+                || h->ncheckpoints != (h->numrows + h->page_lines - 1) / h->page_lines)
+                return 0;
+
+        for (k = 0; k < h->ncheckpoints; k++)
+                if (checkpoints[k] >= h->len
+                        || (k == 0 ? checkpoints[k] != 0 : checkpoints[k] <= checkpoints[k - 1]))
+                        return 0;
+
+        return 1;
+}
+
+/**
+ * Maps the sidecar of filename (absolute, stat'ed to st, its text len
+ * bytes) to c if it is there and is for this very file.
+ *
+ * return 0 ok, -1 no (usable) sidecar
+ */
+int
+line_cache_open(struct line_cache *c, const char *filename, struct stat *st, size_t len, int page_lines) {
+        struct cache_header want;
+        struct cache_header *h;
+        struct stat cst;
+        char path[PATH_MAX];
+        void *map;
+        int fd;
+
+        memset(c, 0, sizeof(struct line_cache));
+        if (cache_path(filename, path, sizeof(path), 0) == -1)
+                return -1;
+
+        fd = open(path, O_RDWR);
+        if (fd == -1)
+                return -1;
+
+        if (fstat(fd, &cst) == -1 || (size_t) cst.st_size < sizeof(struct cache_header)) {
+                close(fd);
+                return -1;
+        }
+
+        map = mmap(NULL, cst.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED)
+                return -1;
+
+        h = map;
+        cache_header_init(&want, st, len, page_lines);
+        if (memcmp(h->magic, want.magic, sizeof(h->magic)) != 0
+                || h->checkpoint_size != want.checkpoint_size
+                || h->page_lines != want.page_lines
+                || h->dev != want.dev || h->ino != want.ino || h->size != want.size
+                || h->len != want.len
+                || h->mtime_sec != want.mtime_sec || h->mtime_nsec != want.mtime_nsec
+                || h->ncheckpoints < 0 || h->numrows < 0
+                || (size_t) cst.st_size != cache_size(h->ncheckpoints)
+                || !cache_checkpoints_ok(h)) {
+                munmap(map, cst.st_size);
+                return -1;
+        }
+
+        c->map = map;
+        c->len = cst.st_size;
+        c->header = h;
+        c->checkpoints = (size_t *) (h + 1);
+        c->states = (unsigned char *) (c->checkpoints + h->ncheckpoints);
+        c->header->mode[CACHE_MODE_LEN - 1] = '\0';
+        return 0;
+}
+
+/**
+ * Writes the sidecar of filename: a temporary file renamed over the old
+ * one, so that a sidecar is never seen half written. The states are not
+ * known yet.
+ *
+ * return 0 ok, -1 not written
+ */
+int
+line_cache_save(const char *filename, struct stat *st, size_t len, int page_lines,
+        size_t *checkpoints, int ncheckpoints, int numrows) {
+        struct cache_header h;
+        char path[PATH_MAX];
+        char tmp[PATH_MAX + 8];
+        unsigned char *states;
+        FILE *fp;
+        int fd;
+        int ok;
+
+        if (cache_path(filename, path, sizeof(path), 1) == -1)
+                return -1;
+
+        snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path);
+        fd = mkstemp(tmp);
+        if (fd == -1)
+                return -1;
+
+        fp = fdopen(fd, "w");
+        if (fp == NULL) {
+                close(fd);
+                unlink(tmp);
+                return -1;
+        }
+
+        states = malloc(ncheckpoints > 0 ? ncheckpoints : 1);
+        if (states != NULL)
+                memset(states, CACHE_STATE_UNKNOWN, ncheckpoints);
+
+        cache_header_init(&h, st, len, page_lines);
+        h.numrows = numrows;
+        h.ncheckpoints = ncheckpoints;
+
+        ok = states != NULL
+                && fwrite(&h, sizeof(h), 1, fp) == 1
+                && fwrite(checkpoints, sizeof(size_t), ncheckpoints, fp) == (size_t) ncheckpoints
+                && fwrite(states, 1, ncheckpoints, fp) == (size_t) ncheckpoints;
+        free(states);
+
+        if (fclose(fp) != 0 || !ok || rename(tmp, path) == -1) {
+                unlink(tmp);
+                return -1;
+        }
+
+        return 0;
+}
+
+void
+line_cache_close(struct line_cache *c) {
+        if (c->map != NULL)
+                munmap(c->map, c->len);
+        memset(c, 0, sizeof(struct line_cache));
+}
@@ -0,0 +1,56 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+/**
+        cache.h
+
+        A sidecar file per big file opened read-only, kept in
+        $XDG_CACHE_HOME/kilo (or ~/.cache/kilo): the line checkpoints of
+        its view, and the multiline comment state at each, so that it
+        need not be scanned again when opened next time. The file is
+        known by its path, device, inode, size and mtime; if any of them
+        changes the sidecar is not used (and gets rewritten).
+
+        The sidecar is mapped shared: states found while viewing are
+        written to it as they are found.
+*/
+
+#define CACHE_MAGIC "KILOLNS2"
+#define CACHE_MODE_LEN 16
+#define CACHE_STATE_UNKNOWN 0xff
+
+struct cache_header {
+        char magic[8];
+        uint32_t checkpoint_size;       /* sizeof(size_t) of the writer. */
+        uint32_t page_lines;
+        uint64_t dev;
+        uint64_t ino;
+        uint64_t size;
+        uint64_t len;                   /* Of the text: more than size if it was gzip. */
+        int64_t mtime_sec;
+        int64_t mtime_nsec;
+        int64_t numrows;
+        int64_t ncheckpoints;
+        char mode[CACHE_MODE_LEN];      /* The mode the states are for. */
+};
+
+/* Followed by: size_t checkpoints[ncheckpoints]; unsigned char states[ncheckpoints]; */
+
+struct line_cache {
+        void *map;              /* NULL if not open. */
+        size_t len;
+        struct cache_header *header;
+        size_t *checkpoints;
+        unsigned char *states;
+};
+
+int line_cache_open(struct line_cache *c, const char *filename, struct stat *st, size_t len, int page_lines);
+int line_cache_save(const char *filename, struct stat *st, size_t len, int page_lines,
+        size_t *checkpoints, int ncheckpoints, int numrows);
+void line_cache_close(struct line_cache *c);
+
+#endif
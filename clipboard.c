@@ -33,12 +33,13 @@ clipboard_add_line_to_clipboard() {
 		clipboard_clear();
 	}
 
-	erow *row = &E->row[E->cy];	
+	erow *row = editor_row_at(E->cy);	
 
 	// Append to the end.
 	C.row = realloc(C.row, sizeof(clipboard_row) * (C.numrows + 1));
 	C.row[C.numrows].row = malloc(row->size);
-	memcpy(C.row[C.numrows].row, row->chars, row->size);
+	editor_row_close_gap(row);
+	memcpy(C.row[C.numrows].row, ROW_CHARS(row), row->size);
 	C.row[C.numrows].size = row->size;
 	C.row[C.numrows].orig_x = E->cx;
 	C.row[C.numrows].orig_y = E->cy;
@@ -1,11 +1,15 @@
 #include <stddef.h>
 #include <fcntl.h>
+#include <limits.h>
 #include "command.h"
 #include "row.h"
 #include "buffer.h"
 #include "clipboard.h"
 #include "file.h"
 #include "find.h"
+#include "save.h"
+#include "gz.h"
+#include "opener.h"
 
 extern struct clipboard C;
 
@@ -97,7 +101,7 @@ struct command_str COMMANDS[] = {
 		"save-buffer",
 		COMMAND_ARG_TYPE_STRING, /* Prompt for new file only. */
 		"Save as: %s",
-		"%d bytes written to %s", // Special handling: %d and %s
+		"%zd bytes written to %s in %.3f s", // Special handling: %zd, %s and %f
 		"Can't save, I/O error: %s" // %s = error
 	},
 	{
@@ -106,7 +110,7 @@ struct command_str COMMANDS[] = {
 		"save-buffer-as",
 		COMMAND_ARG_TYPE_STRING,
 		"Save buffer as: %s",
-		"%d bytes written successfully to %s", // Special handling: %d and %s
+		"%zd bytes written successfully to %s in %.3f s", // Special handling: %zd, %s and %f
 		"Can't save, I/O error: %s" // %s = error
 	},
         {       
@@ -277,10 +281,10 @@ editor_del_char(int undo) {
 	if (E->cx == 0 && E->cy == 0) 
 		return;
 
-	row = &E->row[E->cy];
+	row = editor_row_at(E->cy);
 	if (E->cx > 0) {
 		int orig_cx = E->cx; 
-		int char_to_be_deleted = row->chars[E->cx];
+		int char_to_be_deleted = ROW_CHAR(row, E->cx);
 		int len = editor_row_del_char(row, E->cx - 1);
 
 		if (len > 0) {
@@ -321,8 +325,10 @@ editor_del_char(int undo) {
                 } else {
                         // FIXME undo insert_newline.
                 }  
-		E->cx = E->row[E->cy - 1].size; 
-		editor_row_append_string(&E->row[E->cy - 1], row->chars, row->size); 
+		erow *prev = editor_row_at(E->cy - 1); 
+		E->cx = prev->size; 
+		editor_row_close_gap(row); 
+		editor_row_append_string(prev, ROW_CHARS(row), row->size); 
 		editor_del_row(E->cy);
 		E->cy--; 
 	}
@@ -338,6 +344,9 @@ editor_process_keypress() {
                 
 	int c = key_normalize(key_read());
 
+	if (c == LOAD_KEY)
+		return; /* Not a key: the screen is refreshed with more rows. */
+
         // Cut and paste fix?
         if (previous_key != '\r' && c == '\n')
                 c = '\r';
@@ -357,12 +366,16 @@ editor_process_keypress() {
 		command_insert_newline(); 
 		break;
 	case QUIT_KEY:
+		/* Saves going on are not cut short. */
+		buffer_reap_saves(); 
 		if (E->dirty && quit_times > 0) {
 			editor_set_status_message(UNSAVED_CHANGES_WARNING, quit_times);
 			quit_times--;
 			return; 
 		}
 
+		buffer_drop_journals(); 
+
 		/* Clear the screen at the end. */
 		write(STDOUT_FILENO, "\x1b[2J", 4);
       		write(STDOUT_FILENO, "\x1b[H", 3);
@@ -376,7 +389,7 @@ editor_process_keypress() {
 		break;
 	case END_KEY:
 		if (E->cy < E->numrows)
-			E->cx = E->row[E->cy].size; 
+			E->cx = editor_row_at(E->cy)->size; 
 		break;
 	case FIND_KEY:
 		editor_find();
@@ -397,11 +410,11 @@ editor_process_keypress() {
 		} else if (c == PAGE_DOWN) {
 			E->cy = E->rowoff + TERMINAL.screenrows - 1;
 
-			if (E->cy <= E->numrows) {
+			if (E->cy <= key_last_row()) {
 				times = TERMINAL.screenrows;
 			} else {
-				E->cy = E->numrows; 
-				times = E->numrows - E->rowoff; 
+				E->cy = key_last_row(); 
+				times = key_last_row() - E->rowoff; 
 			}
 		}
 		while (times--)
@@ -432,12 +445,14 @@ editor_process_keypress() {
                 command_refresh_screen(); 
       		break;
       	case KILL_LINE_KEY:
-      		clipboard_add_line_to_clipboard();
+                if (!buffer_is_readonly())
+      		        clipboard_add_line_to_clipboard();
       		break;
       	case YANK_KEY:
         {
                 struct command_str *c = command_get_by_key(COMMAND_YANK_CLIPBOARD);
-      		clipboard_yank_lines(c->success);
+                if (!buffer_is_readonly())
+      		        clipboard_yank_lines(c->success);
       		break;
         }
       	case CLEAR_MODIFICATION_FLAG_KEY:
@@ -452,6 +467,9 @@ editor_process_keypress() {
       	case COMMAND_UNDO_KEY:
       		undo();
       		break;
+	case PASTE_KEY:
+		command_paste(); 
+		break; 
         case GOTO_LINE_KEY:
                 command_goto_line();
                 break;
@@ -505,6 +523,59 @@ is_empty_line(char *line, int linelen) {
         return 1; 
 }
 
+/* Seconds since start. */
+double
+elapsed_since(struct timespec *start) {
+        struct timespec now; 
+
+        clock_gettime(CLOCK_MONOTONIC, &now); 
+        return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9; 
+}
+
+/**
+ * Adds at most max more rows of a file being loaded in the background.
+ * return 1 if the load is still going on
+ */
+int
+editor_load_more(int max) {
+        if (E->loader == NULL)
+                return 0; 
+
+        if (loader_drain(E->loader, max))
+                return 1; 
+
+        if (E->loader->full)
+                editor_set_status_message("Input over %zu MB: the rest was not read.", E->text.reserved >> 20); 
+        else if (E->loader->err != 0)
+                editor_set_status_message("Reading input failed: %s", strerror(E->loader->err)); 
+
+        loader_free(E->loader); 
+        E->loader = NULL; 
+        E->load_time = elapsed_since(&E->load_start); 
+        return 0; 
+}
+
+/**
+ * Waits for numrows rows (INT_MAX: all) of a file being loaded in the
+ * background. A stream is not waited for, as it may never end: the rows
+ * read so far are taken.
+ * return 0 if a stream still being read has fewer rows
+ */
+int
+editor_load_upto(int numrows) {
+        if (E->loader == NULL)
+                return 1; 
+
+        if (E->loader->fd != -1) {
+                editor_load_more(INT_MAX); 
+                return E->loader == NULL || E->numrows >= numrows; 
+        }
+
+        if (!loader_wait(E->loader, numrows))
+                editor_load_more(0); 
+        return 1; 
+}
+
 /* 
  
  kilo implements more or less the GNU Emacs way of choosing the (major) mode.
@@ -605,74 +676,84 @@ get_mode_name(char *line, int linelen) {
         return mode_name; 
 }
 
+/* Is a file of this name saved gzip'd (see gz.h)? */
+static int
+editor_is_gzip_name(const char *filename) {
+        size_t len = strlen(filename); 
+
+        return len > 3 && !strcmp(filename + len - 3, ".gz"); 
+}
+
 /**
- M-x open-file; also used when starting the editor to open files
- specified in the command line.
-*/
-void
-command_open_file(char *filename) {
+ * The rest of opening the file read by j (see opener.h), which needs
+ * the editor: j's text and rows become this buffer's. Frees j.
+ */
+static void
+editor_open_finish(struct open_job *j) {
  	char *line = NULL;
-  	size_t linecap = 0;
+ 	char *p = NULL; 
+ 	char *end = NULL; 
   	ssize_t linelen;
-        struct stat stat_buffer; 
-        FILE *fp = NULL;
-        int free_filename = 0; 
-        int int_arg;
-        char *char_arg; 
 
-        if (filename == NULL) {
-                struct command_str *c = command_get_by_key(COMMAND_OPEN_FILE);
-                int rc = editor_get_command_argument(c, &int_arg, &char_arg);
-                if (rc == 1) {
-                        filename = strdup(char_arg);
-                        free(char_arg);
-                        free_filename = 1; 
-                } else if (rc == 0) {
-                        editor_set_status_message(STATUS_MESSAGE_ABORTED);
-                        return;
-                } else {
-                        editor_set_status_message(c->error_status);
-                        return;
-                }                
-        }
+	E->absolute_filename = j->absolute_filename; 
+        j->absolute_filename = NULL; 
+        if (j->recovered)
+                editor_set_status_message("Finished saving %s: the last save was cut short.", E->basename); 
 
-        /* Yes, needed. */
-        if (E->dirty > 0  
-                || E->numrows > 0 || E->cx > 0 || E->cy > 0 
-                ||  E->filename != NULL) {
-                /* This buffer is in use. Create a new one & use it. */
-                (void) create_buffer(BUFFER_TYPE_FILE, 0, "FIXME: new buffer", COMMAND_NO_CMD); 
+        if (j->failed != NULL) {
+                errno = j->err; 
+                die(j->failed); 
         }
 
-        E->filename = strdup(filename); 
-	E->absolute_filename = realpath(filename, NULL); 
-	E->basename = editor_basename(filename);
-
-  	if (stat(E->filename, &stat_buffer) == -1) {
-  		if (errno == ENOENT) {
-  			E->is_new_file = 1; 
-  			E->dirty = 0; 
-                        if (free_filename)
-                                free(filename);
+  	if (j->is_new) {
+  		E->is_new_file = 1; 
+  		E->dirty = 0; 
+                E->gzip = editor_is_gzip_name(E->filename); 
+                open_job_free(j); 
                                                                 
-                        syntax_set_mode_by_filename_extension(0);
+                syntax_set_mode_by_filename_extension(0);
+                journal_recover(E->filename); 
                         
-  			return; 
-  		} else {
-  			die("stat");
-  		}
+  		return; 
   	}
 
- 	fp = fopen(E->absolute_filename, "r");
-  	if (!fp) {
-  		die("fopen");
- 	}
+        /* The text (and the rows, if made) are taken over as they are. */
+        E->load_start = j->start; 
+        piece_table_free(&E->text); 
+        E->text = j->text; 
+        E->gzip = j->gzip; 
+        if (j->bad_gzip)
+                editor_set_status_message("%s: not valid gzip, opened as is.", E->basename); 
+
+        /* The sizes are of the text: a gzip file is bigger inflated. */
+        if (open_readonly || E->text.orig_len >= KILO_VIEWER_MIN_SIZE) {
+                /* Rows are made a page at a time as they are viewed. */
+                if (view_open(&E->view, E->text.orig, E->text.orig_len,
+                        E->text.orig_len >= KILO_CACHE_MIN_SIZE ? E->absolute_filename : NULL,
+                        &j->st) == -1)
+                        die("view_open");
+                current_buffer->type = BUFFER_TYPE_READONLY; 
+                E->numrows = E->view.numrows; 
+                E->load_time = elapsed_since(&E->load_start); 
+                syntax_set_mode_by_filename_extension(1);
+                open_job_free(j); 
+                return; 
+        }
 
         int match_executable            = !is_syntax_mode_set(); 
         int match_mode_from_comment     = match_executable;
         int line_no                     = 0;                
         
-  	while ((linelen = getline(&line, &linecap, fp)) != -1) {
+        /* The mode is looked for in the first two lines only. */
+        p = E->text.orig;
+        end = p + E->text.orig_len; 
+  	while (p < end && line_no < 2 && (match_executable || match_mode_from_comment)) {
+                char *nl = memchr(p, '\n', end - p);
+
+                line = p; 
+                linelen = (nl != NULL ? nl + 1 : end) - p; 
+                p += linelen; 
+
                 if (linelen > 0 && (line[linelen - 1] == '\n' 
                         || line[linelen - 1] == '\r'))
       		        linelen--;
@@ -709,33 +790,127 @@ command_open_file(char *filename) {
                                 free(executable_name);
                         }
                 }
-                        
-                editor_insert_row(E->numrows, line, linelen);
 	}
+
+        if (j->rows_made) {
+                /* Split by open_job_read(). */
+                line_index_free(&E->lines); 
+                E->lines = j->lines; 
+                E->numrows = j->numrows; 
+                E->load_time = j->load_time; 
+        } else if (E->text.orig_len >= KILO_ASYNC_LOAD_MIN_SIZE) {
+                /* The rest comes in between keys; see editor_load_more(). */
+                E->loader = loader_start(E->text.orig, E->text.orig_len); 
+                loader_wait(E->loader, TERMINAL.screenrows); 
+        } else {
+                editor_load_rows(E->text.orig, E->text.orig_len); 
+                E->load_time = elapsed_since(&E->load_start); 
+        }
         
         if (! is_syntax_mode_set())
                 syntax_set_mode_by_filename_extension(1);
 
-	free(line);
-	fclose(fp);
-        if (free_filename)
-                free(filename); 
+        open_job_free(j); 
                 
 	E->dirty = 0; 
+
+        /* Edits not saved when the editor last went down. */
+        journal_recover(E->absolute_filename); 
 }
 
+/**
+ M-x open-file; also used when starting the editor to open files
+ specified in the command line.
+*/
+void
+command_open_file(char *filename) {
+        struct open_job *j; 
+        int free_filename = 0; 
+        int int_arg;
+        char *char_arg; 
+
+        if (filename == NULL) {
+                struct command_str *c = command_get_by_key(COMMAND_OPEN_FILE);
+                int rc = editor_get_command_argument(c, &int_arg, &char_arg);
+                if (rc == 1) {
+                        filename = strdup(char_arg);
+                        free(char_arg);
+                        free_filename = 1; 
+                } else if (rc == 0) {
+                        editor_set_status_message(STATUS_MESSAGE_ABORTED);
+                        return;
+                } else {
+                        editor_set_status_message(c->error_status);
+                        return;
+                }                
+        }
+
+        /* Yes, needed. */
+        if (E->dirty > 0  
+                || E->numrows > 0 || E->cx > 0 || E->cy > 0 
+                ||  E->filename != NULL || E->loader != NULL) {
+                /* This buffer is in use. Create a new one & use it. */
+                (void) create_buffer(BUFFER_TYPE_FILE, 0, "FIXME: new buffer", COMMAND_NO_CMD); 
+        }
+
+        E->filename = strdup(filename); 
+	E->basename = editor_basename(filename);
+
+        j = open_job_new(filename); 
+        open_job_read(j); 
+        editor_open_finish(j); 
+
+        if (free_filename)
+                free(filename); 
+}
+
+/**
+ * Reads the stream fd (piped input, see terminal_take_stdin()) into a
+ * buffer of its own; the rows come in between keys like those of a big
+ * file (see loader_stream()). It has no name until saved.
+ */
+void
+editor_open_stream(int fd) {
+        if (E->dirty > 0  
+                || E->numrows > 0 || E->cx > 0 || E->cy > 0 
+                ||  E->filename != NULL || E->loader != NULL) 
+                (void) create_buffer(BUFFER_TYPE_FILE, 0, "FIXME: new buffer", COMMAND_NO_CMD); 
+
+        E->basename = strdup("[stdin]"); 
+        clock_gettime(CLOCK_MONOTONIC, &E->load_start); 
+        if (piece_table_reserve(&E->text, KILO_STREAM_MAX_SIZE) == -1)
+                die("piece_table_reserve"); 
+
+        E->loader = loader_stream(fd, E->text.orig, E->text.reserved); 
+        E->dirty = 0; 
+}
 
 /**
- * rc = 0 OK
- * rc = -1 error
- * rc = 1 aborted
+ * Finishes opening the file of this buffer if it was read by the
+ * opener's threads (see open_argument_files()); waits for it if need be.
+ */
+void
+editor_open_pending() {
+        struct open_job *j = E->opening; 
+
+        if (j == NULL)
+                return; 
+
+        E->opening = NULL; 
+        opener_wait(j); 
+        editor_open_finish(j); 
+}
+
+
+/**
+ * Starts saving the buffer (see save_start()); editing goes on while it
+ * is written and editor_save_reap() tells how it went.
  */
 void
 editor_save(int command_key) {
-	int len; 
-	char *buf; 
-	int fd; 
 	char *tmp; 
+	char *target; 
+	int partial; 
 
 	struct command_str *c = command_get_by_key(command_key);
 	if (c == NULL) {
@@ -743,6 +918,16 @@ editor_save(int command_key) {
 		return;
 	}
 
+        if (buffer_is_readonly())
+                return; 
+
+        /* 
+         * Rows still being loaded are saved, too, but of a stream only those
+         * read so far; a save still going on first ends.
+         */
+        partial = !editor_load_upto(INT_MAX); 
+        editor_save_reap(1); 
+
 	if (command_key == COMMAND_SAVE_BUFFER_AS || E->filename == NULL) {
 		tmp = editor_prompt(c->prompt, NULL); 
 		if (tmp != NULL) {
@@ -753,6 +938,7 @@ editor_save(int command_key) {
 			E->filename = strdup(tmp); 
 			E->absolute_filename = strdup(E->filename); // realpath(E->filename, NULL) returns NULL.; 
 			E->basename = editor_basename(E->filename);
+                        E->gzip = editor_is_gzip_name(E->filename); 
                         syntax_select_highlight(NULL, 0);
                         free(tmp);
 
@@ -762,61 +948,98 @@ editor_save(int command_key) {
 		}
 	}
 
-	buf = editor_rows_to_string(&len);
-
-
-        if (buf == NULL || buf[0] == '\0') {
+        if (E->numrows == 0) {
                 if (! E->dirty) { 
                         editor_set_status_message("Empty buffer -- not saved.");
                         return;
                 } else {
-                        // Add a newline and re-buf.
+                        // Add a newline to save.
                         editor_insert_newline();
-                        buf = editor_rows_to_string(&len);                                 
                 }
         }
 
-	fd = open(E->filename, O_RDWR | O_CREAT, 0644);
-	if (fd != -1) {
-		if (ftruncate(fd, len) != -1) {
-			if (write(fd, buf, len) == len) {
-                
-                                close(fd);
-                                free(buf);
-                                E->dirty = 0;
-                                E->is_new_file = 0;  
-
-                                // if (strlen(abs) + strlen(success) > TERMINAL.screencols (not 100% acc)
-                                // then cut X 
-                                if (E->absolute_filename
-                                        && (strlen(E->absolute_filename) + strlen(c->success) > TERMINAL.screencols)) {
-                                        char *status_filename = malloc(TERMINAL.screencols + 1);
-
-                                        int truncate_len = strlen(E->absolute_filename) + strlen(c->success) 
-                                                - TERMINAL.screencols + 3; // "..."
-                                                
-                                        memset(status_filename, '\0', TERMINAL.screencols + 1);
-                                        strncpy(status_filename, "...", 3);
-                                        strncpy(status_filename+3, E->absolute_filename+truncate_len, 
-                                                strlen(E->absolute_filename)-truncate_len);
-                                        status_filename[TERMINAL.screencols] = '\0';        
-                                        editor_set_status_message(c->success, // TODO Special case: both %d and %s
-                                                len, status_filename); // ? E->absolute_filename : E->filename);
-                                        free(status_filename);
-                                } else {
-                                        editor_set_status_message(c->success, len, E->absolute_filename ? E->absolute_filename : E->filename);
-                                }
+        target = E->absolute_filename != NULL ? E->absolute_filename : E->filename; 
+        E->save = save_start(target); 
+        E->save->command_key = command_key; 
+        E->save->partial = partial ? E->numrows : 0; 
+        if (E->journal != NULL)
+                journal_mark(E->journal); 
+
+        /*
+         * Rows changed from now on are not in this save. Only an in-place
+         * save leaves the mapped file as the rows: after any other, the
+         * file may still be unchanged (saved elsewhere) and an in-place
+         * save to it later must write every row changed since it was loaded.
+         */
+        if (E->save->in_place)
+                E->dirty_from = INT_MAX; 
+}
 
-				return; // fd closed, buf freed.
-			} // if write ok
-			syntax_select_highlight(NULL, 0); 
-		}
-		close(fd);
-	}
-	free(buf);
+/**
+ * Reaps the save of the buffer if it is over, or waits for it if wait
+ * is set. The buffer is no longer modified if it was not edited since
+ * the save started.
+ */
+void
+editor_save_reap(int wait) {
+        struct save_job *j = E->save; 
+        struct command_str *c; 
+
+        if (j == NULL || (!wait && !save_done(j)))
+                return; 
+
+        E->save = NULL; 
+        c = command_get_by_key(j->command_key); 
+
+        if (save_finish(j) == -1) {
+                /* Those rows are still to be written. */
+                if (j->dirty_from < E->dirty_from)
+                        E->dirty_from = j->dirty_from; 
+                syntax_select_highlight(NULL, 0); 
+                editor_set_status_message(c->error_status, strerror(errno));
+                save_free(j); 
+                return; 
+        }
+
+        if (j->in_place) {
+                E->text.size = j->st.st_size; 
+                E->text.mtime = j->st.st_mtim; 
+        }
+        /* The journal keeps only the edits since the snapshot, if any. */
+        if (E->changes == j->changes)
+                E->dirty = 0;
+        if (E->journal != NULL && (E->changes == j->changes
+                || journal_rebase(E->journal, j->target) == -1)) {
+                journal_free(E->journal, 0); 
+                E->journal = NULL; 
+        }
+        E->is_new_file = 0;  
+
+        // if (strlen(abs) + strlen(success) > TERMINAL.screencols (not 100% acc)
+        // then cut X 
+        if (E->absolute_filename
+                && (strlen(E->absolute_filename) + strlen(c->success) > TERMINAL.screencols)) {
+                char *status_filename = malloc(TERMINAL.screencols + 1);
 
-	editor_set_status_message(c->error_status, strerror(errno));
-	return; 
+                int truncate_len = strlen(E->absolute_filename) + strlen(c->success) 
+                        - TERMINAL.screencols + 3; // "..."
+                        
+                memset(status_filename, '\0', TERMINAL.screencols + 1);
+                strncpy(status_filename, "...", 3);
+                strncpy(status_filename+3, E->absolute_filename+truncate_len, 
+                        strlen(E->absolute_filename)-truncate_len);
+                status_filename[TERMINAL.screencols] = '\0';        
+                editor_set_status_message(c->success, // TODO Special case: both %d and %s
+                        (ssize_t) j->length, status_filename, elapsed_since(&j->start)); // ? E->absolute_filename : E->filename);
+                free(status_filename);
+        } else {
+                editor_set_status_message(c->success, (ssize_t) j->length, 
+                        E->absolute_filename ? E->absolute_filename : E->filename,
+                        elapsed_since(&j->start));
+        }
+        if (j->partial > 0)
+                editor_set_status_message("Saved the %d lines read so far; the input is not over.", j->partial); 
+        save_free(j); 
 } /* editor_save -> Acommand_save ... */
 
 
@@ -848,7 +1071,8 @@ command_get_by_key(int command_key) {
 
 void
 command_insert_char(int character) {
-
+        if (buffer_is_readonly())
+                return; 
         
 	if (E->ascii_only 
                 && character <= 31 && character != 9) // TODO 9 = TABKEY
@@ -860,6 +1084,8 @@ command_insert_char(int character) {
 
 void 
 command_delete_char() {
+        if (buffer_is_readonly())
+                return; 
 	editor_del_char(0);
 	undo_debug_stack(); 
 	command_debug(COMMAND_DELETE_CHAR);
@@ -867,7 +1093,12 @@ command_delete_char() {
 
 void 
 command_insert_newline() {
-	int indent_len = editor_insert_newline();
+	int indent_len; 
+
+        if (buffer_is_readonly())
+                return; 
+
+	indent_len = editor_insert_newline();
 	if (E->is_auto_indent 
 		&& (indent_len % E->tab_stop == 0)) { // 1 for newline
 		indent_len = indent_len / E->tab_stop; // no of tabs, soft or hard.
@@ -881,6 +1112,49 @@ command_insert_newline() {
 		editor_set_status_message("Inserted newline");
 }
 
+/**
+ * Inserts a bracketed paste as one edit: as it is, without auto-indent
+ * re-indenting it, and undone with one undo.
+ */
+void
+command_paste() {
+	struct undo_str *undo = current_buffer->undo_stack; 
+	size_t len; 
+	int more; 
+	char *paste = key_paste(&len, &more); 
+	char *text; 
+	size_t i; 
+	size_t n = 0; 
+
+        if (buffer_is_readonly() || len == 0)
+                return; 
+
+	text = malloc(len); 
+	if (text == NULL)
+		die("command_paste"); 
+
+	for (i = 0; i < len; i++) {
+		char c = paste[i]; 
+
+		if (E->ascii_only && c >= 0 && c <= 31 && c != '\t' && c != '\n')
+			continue; 
+		text[n++] = c; 
+	}
+
+	/* The rest of a paste cut short is the same edit: one undo. */
+	if (!more || undo == NULL || undo->command_key != COMMAND_PASTE
+		|| undo->end_cx != E->cx || undo->end_cy != E->cy) {
+		undo = alloc_and_init_undo(COMMAND_PASTE); 
+		undo->undo_command_key = COMMAND_DELETE_PASTE; 
+		undo->orig_value = E->cy == E->numrows; /* The paste makes its first row. */
+	}
+	editor_insert_text(text, n); 
+	undo->end_cx = E->cx; 
+	undo->end_cy = E->cy; 
+	undo_debug_stack(); 
+	free(text); 
+}
+
 /**
   Return:
   0 = no argument gotten
@@ -979,6 +1253,8 @@ command_goto_line() {
                 return;
         }
         
+        if (!editor_load_upto(int_arg + 1) && int_arg >= E->numrows) 
+                editor_set_status_message("Line %d is not read yet.", int_arg); 
         if (int_arg > 0 && int_arg < E->numrows) { 
                 E->cy = int_arg - 1; 
                 command_refresh_screen();        
@@ -995,7 +1271,9 @@ command_goto_beginning_of_file() {
 
 void
 command_goto_end_of_file() {
-        E->cy = E->numrows;
+        if (!editor_load_upto(INT_MAX))
+                editor_set_status_message("The end of the lines read so far; the input is not over."); 
+        E->cy = key_last_row();
         E->cx = 0;       
 }
 
@@ -1065,6 +1343,7 @@ exec_command() {
 				if (int_arg >= 2) { 
 					undo_push_one_int_arg(COMMAND_SET_TAB_STOP, COMMAND_SET_TAB_STOP, E->tab_stop);
 					E->tab_stop = int_arg; 
+					E->render_gen++; 
 					editor_set_status_message(c->success, int_arg);
 				} else {
 					editor_set_status_message(c->error_status, char_arg);
@@ -1123,6 +1402,7 @@ exec_command() {
 				command_insert_newline();
 				break;
                         case COMMAND_GOTO_LINE:
+                                editor_load_upto(int_arg + 1); 
                                 if (int_arg >= 0 && int_arg < E->numrows) {
                                         undo_push_one_int_arg(COMMAND_GOTO_LINE, COMMAND_GOTO_LINE, E->cy);
                                         E->cy = int_arg;
@@ -44,7 +44,9 @@ enum command_key {
         COMMAND_PREVIOUS_BUFFER, /* Esc-P */
         COMMAND_MARK,
         COMMAND_COPY_REGION,
-        COMMAND_KILL_REGION
+        COMMAND_KILL_REGION,
+        COMMAND_PASTE, /* for undo */
+        COMMAND_DELETE_PASTE /* for undo only */
 };
 
 enum command_arg_type {
@@ -68,12 +70,23 @@ int command_entries();
 void editor_del_char(int undo);
 void editor_process_keypress();
 void command_open_file(char *filename);
+void editor_open_pending();
+void editor_open_stream(int fd);
 void editor_save(int command_key);
+void editor_save_reap(int wait);
+int editor_load_more(int max);
+int editor_load_upto(int numrows);
+double elapsed_since(struct timespec *start);
+
+int open_readonly; /* --readonly: open files in read-only buffers. */
+int fsync_policy; /* --fsync: FSYNC_NONE, FSYNC_DATA or FSYNC_FULL. */
+int gzip_level; /* --gzip-level: of gzip files saved, 1 to 9. */
 void command_debug(int command_key);
 struct command_str *command_get_by_key(int command_key);
 void command_insert_char(int character);
 void command_delete_char();
 void command_insert_newline();
+void command_paste();
 int editor_get_command_argument(struct command_str *c, int *ret_int, char **ret_string);
 void command_move_cursor(int command_key);
 void command_goto_line();
@@ -10,6 +10,29 @@
 
 #define KILO_QUIT_TIMES 3
 #define STATUS_MESSAGE_ABORTED "Aborted."
+#define READONLY_STATUS_MESSAGE "Read-only buffer."
+/* Bigger files are opened read-only (see view.h); so is any with --readonly. */
+#define KILO_VIEWER_MIN_SIZE (1024L * 1024 * 1024)
+/* From this size on the rows are loaded in the background (see loader.h). */
+#define KILO_ASYNC_LOAD_MIN_SIZE (32L * 1024 * 1024)
+/* A read-only file this big gets its line index cached (see cache.h). */
+#define KILO_CACHE_MIN_SIZE (64L * 1024 * 1024)
+/* Piped input (kilo -) is kept up to this size, or less if the memory is not there. */
+#define KILO_STREAM_MAX_SIZE (64L * 1024 * 1024 * 1024)
+/* --fsync: how far a save is flushed to the disk before it is renamed in place. */
+#define FSYNC_NONE 0
+#define FSYNC_DATA 1 /* fdatasync() the file. */
+#define FSYNC_FULL 2 /* fsync() the file and, after the rename, its directory. */
+#define DEFAULT_FSYNC_POLICY FSYNC_DATA
+#define DEFAULT_GZIP_LEVEL 6 /* As gzip's. */
+/* --io: how files are read and written in bulk (see uring.h). */
+#define IO_SYNC 0 /* read() and write(). */
+#define IO_URING 1 /* io_uring, if the kernel has it; else as IO_SYNC. */
+#define DEFAULT_IO_BACKEND IO_SYNC
+/* Files this big are saved in place from the first change on (see save.h)... */
+#define KILO_INCREMENTAL_SAVE_MIN_SIZE (64L * 1024 * 1024)
+/* ...if no more than this of the file is after it. */
+#define KILO_INCREMENTAL_SAVE_MAX_TAIL (64L * 1024 * 1024)
 #define DEFAULT_SEARCH_PROMPT "Search: %s (Use ESC/Arrows/Enter)"
 #define UNSAVED_CHANGES_WARNING "WARNING!!! File has unsaved changes. " \
 			        "Press Ctrl-Q %d more times to quit."
@@ -17,5 +40,9 @@
 #define DEBUG_UNDOS (1<<0)
 #define DEBUG_COMMANDS (1<<1)
 #define DEBUG_CURSOR (1<<2) 
+#define DEBUG_MEMORY (1<<3)
+#define DEBUG_LOAD (1<<4)
+#define DEBUG_JOURNAL (1<<5)
+#define DEBUG_OUTPUT (1<<6)
 
 #endif
@@ -10,16 +10,47 @@
  */
 #include <ctype.h>
 #include <time.h>
+#include "piece.h"
+#include "lines.h"
+#include "view.h"
+#include "loader.h"
+#include "save.h"
+#include "journal.h"
+#include "opener.h"
 
 /* From row.h */
+#define ROW_INLINE_SIZE 16 /* Rows shorter than this are kept in the erow itself. */
+
+/* hl of a row as runs: a span lasts until the next one starts. */
+struct hl_span {
+	int start; /* Render column. */
+	unsigned char hl; 
+};
+
+/* Built when a row is drawn (or searched); see editor_row_rendered(). */
+struct row_render {
+	int rsize; 
+	int nspans; 
+	int cntrl; /* Has control characters, drawn as such. */
+	char *render; /* NULL: no tabs, the chars of the row are rendered as such. */
+	struct hl_span spans[]; 
+};
+
 typedef struct erow {
-	int idx;
+	struct line_block *block; /* The row number is derived from this. */
+	union {
+		struct {
+			char *chars; /* A view into E->text or writable storage in its add buffer. */
+			int capacity; /* 0 = read-only view, not '\0' terminated. */
+			int gap_start; /* Writable rows: all the slack is a gap at gap_start. */
+		}; 
+		char inl[ROW_INLINE_SIZE]; /* ROW_INLINE: the chars, '\0' terminated. */
+	}; 
+	struct row_render *r; 
 	int size; 
-	int rsize; 
-	char *chars;
-	char *render; 
-	unsigned char *hl; 
-	int hl_open_comment; 
+	unsigned short gen; 
+	unsigned char flags; /* ROW_RENDERED, ROW_HL_STATE, ROW_INLINE */
+	unsigned char hl_open_comment; 
 } erow;
 
 
@@ -29,8 +60,15 @@ struct editor_config {
 	int rowoff;
 	int coloff; 
 	int numrows;
-	erow *row; 
+	struct line_index lines; /* The rows; see editor_row_at(). */
+	struct line_view view; /* Or these, in a read-only buffer. */
+	struct piece_table text; /* Storage for row chars. */
+	unsigned short render_gen; /* Bumped to re-render all rows (mode, tab stop). */
+	int match_row; /* Set by find: HL_MATCH over [match_start, match_end[ of this row. */
+	int match_start, match_end; 
 	int dirty; 
+	int dirty_from; /* The first row changed since loaded or saved; INT_MAX if none. */
+	unsigned long changes; /* Row changes ever; a save knows if any came after it. */
 	char *filename; 
 	char *absolute_filename; 
 	char *basename; 
@@ -38,11 +76,19 @@ struct editor_config {
 	time_t statusmsg_time; 
 	struct editor_syntax *syntax; 
 	int is_new_file; 
+	int gzip; /* Saved gzip'd: read from a gzip file or named *.gz. */
 	int is_banner_shown; /* If shown once do not show again. */
 	int is_soft_indent; 
 	int is_auto_indent; 
 	int tab_stop;  
 	int debug; 
+	struct loader *loader; /* Non-NULL while rows are still being loaded. */
+	struct timespec load_start; 
+	double load_time; /* Seconds opening the file took. */
+	struct save_job *save; /* Non-NULL while the rows are being saved. */
+	struct journal *journal; /* The edits not saved; made by the first one. */
+	int no_journal; /* It could not be made. */
+	struct open_job *opening; /* Non-NULL until the file read by the opener is shown (see opener.h). */
         /* Set by COMMAND_MARK. Default values -1. */
         int mark_x, mark_y; 
         int ascii_only; 
@@ -1,34 +1,40 @@
 /*** file.c ***/
 
+#include <errno.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include "data.h"
+#include "file.h"
+#include "row.h"
 
 extern struct editor_config *E;
 
-char *
-editor_rows_to_string(int *buflen) {
-	int totlen = 0; 
-	int j; 
-	char *buf; 
-	char *p; 
-
-	for (j = 0; j < E->numrows; j++)
-		totlen += E->row[j].size + 1; 
-
-	*buflen = totlen; 
-
-	buf = malloc(totlen); 
-	p = buf; 
-
-	for (j = 0; j < E->numrows; j++) {
-		memcpy(p, E->row[j].chars, E->row[j].size);
-		p += E->row[j].size; 
-		*p = '\n';
-		p++;
+/* Writes iov[0..n[ to fd, going on after partial writes. return 0 ok, -1 error */
+int
+write_all(int fd, struct iovec *iov, int n) {
+	while (n > 0) {
+		ssize_t written = writev(fd, iov, n); 
+
+		if (written == -1) {
+			if (errno == EINTR)
+				continue; 
+			return -1; 
+		}
+
+		/* Skip what went out; the rest of a segment is written next. */
+		while (n > 0 && (size_t) written >= iov->iov_len) {
+			written -= iov->iov_len; 
+			iov++; 
+			n--; 
+		}
+		if (n > 0) {
+			iov->iov_base = (char *) iov->iov_base + written; 
+			iov->iov_len -= written; 
+		}
 	}
 
-	return buf; 
+	return 0; 
 }
 
 char *
@@ -6,7 +6,15 @@
         
 */
 
-char *editor_rows_to_string(int *buflen);
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024 /* As on Linux; not in <limits.h> without _XOPEN_SOURCE. */
+#endif
+
+int write_all(int fd, struct iovec *iov, int n);
 char *editor_basename(char *path);
 
 #endif
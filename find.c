@@ -7,23 +7,32 @@
 #include "find.h"
 
 
+/* The first column of query in the render of row or -1. */
+static int
+find_in_row(erow *row, char *query) {
+	char *render = ROW_RENDER(row); 
+	int len = strlen(query); 
+	int i; 
+
+	for (i = 0; i + len <= row->r->rsize; i++) 
+		if (!memcmp(&render[i], query, len))
+			return i; 
+
+	return -1; 
+}
+
 void
 editor_find_callback(char *query, int key) {
 	static int last_match = -1; 
 	static int direction = 1; 
-	static int saved_hl_line; 
-	static char *saved_hl; 
 
-	if (saved_hl) {
-		memcpy(E->row[saved_hl_line].hl, saved_hl, E->row[saved_hl_line].rsize);
-		free(saved_hl);
-		saved_hl = NULL; 
-	}
+	E->match_row = -1; /* Removes HL_MATCH. */
 
 	int current; 
 	erow *row; 
-	char *match; 
+	int match; 
 	int i; 
+	int was_rendered; 
 
 	if (key == '\r' || key == '\x1b') {
 		last_match = -1; 
@@ -49,21 +58,26 @@ editor_find_callback(char *query, int key) {
 		else if (current == E->numrows)
 			current = 0; 
 
-		row = &E->row[current];
-		match = strstr(row->render, query); 
-		if (match) {
+		row = editor_row_at(current);
+		was_rendered = ROW_IS(row, ROW_RENDERED); 
+		row = editor_row_rendered(current);
+		match = find_in_row(row, query); 
+		if (match != -1) {
 			last_match = current; 
 			E->cy = current; 
-			E->cx = editor_row_rx_to_cx(row, match - row->render); 
+			E->cx = editor_row_rx_to_cx(row, match); 
 			E->rowoff = E->numrows; 
 
-			saved_hl_line = current; 
-			saved_hl = malloc(row->rsize);
-			memcpy(saved_hl, row->hl, row->rsize);
-			memset(&row->hl[match - row->render], HL_MATCH, strlen(query));
+			E->match_row = current; 
+			E->match_start = match; 
+			E->match_end = match + strlen(query); 
 
 			break; 
 		}
+
+		/* Do not keep render & hl of every row searched. */
+		if (!was_rendered)
+			editor_row_drop_render(row); 
 	}
 }
 
@@ -80,6 +94,7 @@ editor_prompt(char *prompt, void (*callback) (char *, int)) {
 	size_t bufsize = 256; 
 	char *buf = malloc(bufsize); 
 	size_t buflen = 0; 
+	int paste_line_over = 0; /* The first line of a paste is in. */
 	int c; 
 
 	buf[0] = '\0';
@@ -90,7 +105,9 @@ editor_prompt(char *prompt, void (*callback) (char *, int)) {
 
 		c = key_read();
 		
-		if (c == DEL_KEY || c == CTRL_KEY('h') || c == BACKSPACE) {
+		if (c == LOAD_KEY) {
+			continue; 
+		} else if (c == DEL_KEY || c == CTRL_KEY('h') || c == BACKSPACE) {
 			if (buflen != 0) 
 				buf[--buflen] = '\0';
 		} else if (c == '\x1b') {
@@ -117,6 +134,29 @@ editor_prompt(char *prompt, void (*callback) (char *, int)) {
 			}
 			buf[buflen++] = c; 
 			buf[buflen] = '\0';
+		} else if (c == PASTE_KEY) {
+			/* The first line of it. */
+			size_t len; 
+			int more; 
+			char *paste = key_paste(&len, &more); 
+			size_t i; 
+
+			if (!more)
+				paste_line_over = 0; 
+			for (i = 0; !paste_line_over && i < len; i++) {
+				if (paste[i] == '\n') {
+					paste_line_over = 1; 
+					break; 
+				}
+				if (iscntrl(paste[i]))
+					continue; 
+				if (buflen == bufsize - 1) {
+					bufsize *= 2; 
+					buf = realloc(buf, bufsize); 
+				}
+				buf[buflen++] = paste[i]; 
+				buf[buflen] = '\0';
+			}
 		}
 
 		if (callback)
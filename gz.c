@@ -0,0 +1,227 @@
+#define _GNU_SOURCE /* mremap() */
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "gz.h"
+#include "file.h"
+#include "uring.h"
+
+/**
+        gz.c
+*/
+
+/* Are the first bytes of fd those of a gzip file? */
+int
+gz_is_gzip(int fd) {
+        unsigned char magic[2];
+
+        return pread(fd, magic, 2, 0) == 2 && magic[0] == GZ_MAGIC0 && magic[1] == GZ_MAGIC1;
+}
+
+/* A first guess of the inflated size: the trailer has it (mod 4GB) for a one member file. */
+static size_t
+gz_size_hint(int fd) {
+        unsigned char isize[4];
+        struct stat st;
+        size_t hint;
+
+        if (fstat(fd, &st) == -1 || st.st_size < 18
+                || pread(fd, isize, 4, st.st_size - 4) != 4)
+                return GZ_CHUNK;
+
+        hint = isize[0] | isize[1] << 8 | isize[2] << 16 | (size_t) isize[3] << 24;
+        return hint > (size_t) st.st_size ? hint : (size_t) st.st_size * 4;
+}
+
+/**
+ * Inflates the gzip file fd (all of its members) into an anonymous
+ * mapping, which grows by mremap(): pages are moved, not copied. The
+ * mapping is cut down to the text in the end, so munmap(*text, *len)
+ * frees it.
+ *
+ * return 0 ok, -1 error (errno is set; EINVAL if not valid gzip)
+ */
+int
+gz_inflate(int fd, char **text, size_t *len) {
+        struct uring_reader rd;
+        char *in;
+        size_t cap = gz_size_hint(fd) + 1; /* Room to tell the end without growing. */
+        size_t used;
+        char *p;
+        z_stream z;
+        int ended = 0;          /* A member ended and no other began. */
+        int fresh = 0;          /* A member began with no output yet. */
+        int save_errno = EINVAL;
+
+        p = mmap(NULL, cap, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+                return -1;
+
+        /* The next chunks are read (with --io uring) while this one is inflated. */
+        if (uring_reader_open(&rd, fd, 0) == -1) {
+                munmap(p, cap);
+                return -1;
+        }
+
+        memset(&z, 0, sizeof(z));
+        if (inflateInit2(&z, 16 + MAX_WBITS) != Z_OK) {
+                uring_reader_close(&rd);
+                munmap(p, cap);
+                errno = ENOMEM;
+                return -1;
+        }
+        z.next_out = (unsigned char *) p;
+        z.avail_out = cap > UINT_MAX ? UINT_MAX : cap;
+
+        for (;;) {
+                int rc;
+
+                if (z.avail_in == 0) {
+                        ssize_t n = uring_reader_next(&rd, &in);
+
+                        if (n == -1) {
+                                save_errno = errno;
+                                goto fail;
+                        }
+                        if (n == 0)
+                                break;
+                        z.next_in = (unsigned char *) in;
+                        z.avail_in = n;
+                }
+
+                used = (char *) z.next_out - p;
+                if (z.avail_out == 0) {
+                        char *q = mremap(p, cap, cap * 2, MREMAP_MAYMOVE);
+
+                        if (q == MAP_FAILED) {
+                                save_errno = errno;
+                                goto fail;
+                        }
+                        p = q;
+                        cap *= 2;
+                        z.next_out = (unsigned char *) p + used;
+                        z.avail_out = cap - used > UINT_MAX ? UINT_MAX : cap - used;
+                }
+
+                if (ended) {
+                        /* Another member follows (as from cat a.gz b.gz). */
+                        inflateReset(&z);
+                        ended = 0;
+                        fresh = 1;
+                }
+
+                rc = inflate(&z, Z_NO_FLUSH);
+                if (rc == Z_STREAM_END) {
+                        ended = 1;
+                } else if (rc == Z_DATA_ERROR && fresh) {
+                        ended = 1; /* Not a member: padding after the last one, as gzip -d takes it. */
+                        break;
+                } else if (rc != Z_OK && rc != Z_BUF_ERROR) {
+                        goto fail;
+                }
+                if ((size_t) ((char *) z.next_out - p) > used)
+                        fresh = 0;
+        }
+
+        if (!ended)
+                goto fail; /* Cut short. */
+
+        inflateEnd(&z);
+        uring_reader_close(&rd);
+        *len = (char *) z.next_out - p;
+        if (*len == 0) {
+                munmap(p, cap);
+                *text = NULL;
+                return 0;
+        }
+
+        /* Give back the rest. */
+        if (cap > *len)
+                mremap(p, cap, *len, 0);
+        *text = p;
+        return 0;
+
+fail:
+        inflateEnd(&z);
+        uring_reader_close(&rd);
+        munmap(p, cap);
+        errno = save_errno;
+        return -1;
+}
+
+/* Writes what deflate() put out so far to g->fd. */
+static int
+gz_writer_flush(struct gz_writer *g) {
+        struct iovec iov;
+        size_t n = sizeof(g->out) - g->z.avail_out;
+
+        iov.iov_base = g->out;
+        iov.iov_len = n;
+        if (n > 0 && write_all(g->fd, &iov, 1) == -1)
+                return -1;
+
+        g->written += n;
+        g->z.next_out = g->out;
+        g->z.avail_out = sizeof(g->out);
+        return 0;
+}
+
+/* Starts a gzip stream of the given level (1-9) to fd. return 0 ok, -1 error */
+int
+gz_writer_open(struct gz_writer *g, int fd, int level) {
+        memset(&g->z, 0, sizeof(g->z));
+        g->fd = fd;
+        g->written = 0;
+        if (deflateInit2(&g->z, level, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+                errno = ENOMEM;
+                return -1;
+        }
+
+        g->z.next_out = g->out;
+        g->z.avail_out = sizeof(g->out);
+        return 0;
+}
+
+/* Deflates len bytes at p to the stream. return 0 ok, -1 error */
+int
+gz_writer_write(struct gz_writer *g, const void *p, size_t len) {
+        while (len > 0) {
+                uInt n = len > UINT_MAX ? UINT_MAX : len;
+
+                g->z.next_in = (unsigned char *) p;
+                g->z.avail_in = n;
+                while (g->z.avail_in > 0) {
+                        if (deflate(&g->z, Z_NO_FLUSH) == Z_STREAM_ERROR) {
+                                errno = EIO;
+                                return -1;
+                        }
+                        if (g->z.avail_out == 0 && gz_writer_flush(g) == -1)
+                                return -1;
+                }
+                p = (const char *) p + n;
+                len -= n;
+        }
+
+        return 0;
+}
+
+/* Ends the stream (and frees g's zlib state). return 0 ok, -1 error */
+int
+gz_writer_close(struct gz_writer *g) {
+        int rc;
+
+        do {
+                rc = deflate(&g->z, Z_FINISH);
+                if (rc == Z_STREAM_ERROR || gz_writer_flush(g) == -1) {
+                        deflateEnd(&g->z);
+                        return -1;
+                }
+        } while (rc != Z_STREAM_END);
+
+        deflateEnd(&g->z);
+        return 0;
+}
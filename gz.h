@@ -0,0 +1,34 @@
+#ifndef GZ_H
+#define GZ_H
+
+#include <stddef.h>
+#include <zlib.h>
+
+/**
+        gz.h
+
+        gzip files, known by their magic bytes (not the name). One is
+        inflated as it is read, a chunk at a time, straight into the
+        memory the rows are views of: the text is in memory once, and the
+        compressed file not at all. A save deflates the rows on their way
+        to the file (see save.c).
+*/
+
+#define GZ_MAGIC0 0x1f
+#define GZ_MAGIC1 0x8b
+#define GZ_CHUNK (64 * 1024)
+
+struct gz_writer {
+        z_stream z;
+        int fd;
+        size_t written;         /* Compressed bytes written to fd. */
+        unsigned char out[GZ_CHUNK];
+};
+
+int gz_is_gzip(int fd);
+int gz_inflate(int fd, char **text, size_t *len);
+int gz_writer_open(struct gz_writer *g, int fd, int level);
+int gz_writer_write(struct gz_writer *g, const void *p, size_t len);
+int gz_writer_close(struct gz_writer *g);
+
+#endif
@@ -43,8 +43,13 @@
 	"Awk, Bazel, C, Chapel, C#, Docker, Elm, Erlang, Go, Groovy, Haxe,\r\n" \
         "Java, JavaScript, Kotlin, Lua, Makefile, nginx, Perl, PHP, Python,\r\n" \
         "R, Ruby, Scala, Shell, SQL & Text.\r\n" \
-        "Usage: kilo [--help|-h|--version|-v|--ascii|-a] [--] [file] [file] ...\r\n" \
-        "\t--ascii allows only ascii characters.\r\n"  
+        "Usage: kilo [--help|-h|--version|-v|--ascii|-a|--readonly|-r|--fsync|-f none|data|full|--gzip-level|-z 1-9|--io|-i sync|uring] [--] [file] [file] ...\r\n" \
+        "\t--ascii allows only ascii characters.\r\n" \
+        "\t--readonly opens files for viewing only (files over 1GB always are).\r\n" \
+        "\t--fsync says how a save is flushed to the disk (default: data).\r\n" \
+        "\t--gzip-level is how hard gzip files are compressed when saved (default: 6).\r\n" \
+        "\t--io uring reads and writes files in bulk through io_uring (default: sync).\r\n" \
+        "\tA file named - (or none, with input piped to kilo) is the piped input.\r\n"  
 
 void display_help();
 #endif
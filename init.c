@@ -1,3 +1,4 @@
+#include <limits.h>
 #include "init.h"
 
 void
@@ -9,7 +10,13 @@ init_config(struct editor_config *cfg) {
         cfg->rowoff = 0;
         cfg->coloff = 0;
         cfg->dirty = 0;
-        cfg->row = NULL; 
+        cfg->dirty_from = INT_MAX;
+        cfg->changes = 0;
+        line_index_init(&cfg->lines);
+        view_init(&cfg->view);
+        cfg->render_gen = 0;
+        cfg->match_row = -1;
+        piece_table_init(&cfg->text);
         cfg->filename = NULL; 
         cfg->absolute_filename = NULL; 
         cfg->basename = NULL; 
@@ -17,11 +24,18 @@ init_config(struct editor_config *cfg) {
         cfg->statusmsg_time = 0; 
         cfg->syntax = NULL; 
         cfg->is_new_file = 0;
+        cfg->gzip = 0;
         cfg->is_banner_shown = 0; 
         cfg->tab_stop = DEFAULT_KILO_TAB_STOP;
         cfg->is_soft_indent = 0;
         cfg->is_auto_indent = 0;
         cfg->debug = 0;
+        cfg->loader = NULL;
+        cfg->load_time = 0;
+        cfg->save = NULL;
+        cfg->journal = NULL;
+        cfg->no_journal = 0;
+        cfg->opening = NULL;
         cfg->mark_x = -1; 
         cfg->mark_y = -1; 
 }
@@ -0,0 +1,504 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "journal.h"
+#include "command.h"
+#include "file.h"
+#include "find.h"
+#include "row.h"
+
+/**
+        journal.c
+
+        journal_record() is on the path of every key press: it only
+        encodes the record and copies it to the pending buffer.
+*/
+
+/* Set while a journal is replayed: the edits are in it already. */
+static int journal_replaying = 0;
+
+/* Set while an edit made of others is done: it is one record (see journal_pause()). */
+static int journal_paused = 0;
+
+/* The name of the journal of filename; to be freed. */
+static char *
+journal_name(const char *filename) {
+        char *name = malloc(strlen(filename) + sizeof(JOURNAL_SUFFIX));
+
+        if (name != NULL)
+                sprintf(name, "%s%s", filename, JOURNAL_SUFFIX);
+
+        return name;
+}
+
+/* Fills h for filename as it is on the disk now. */
+static void
+journal_header_init(struct journal_header *h, const char *filename) {
+        struct stat st;
+
+        memset(h, 0, sizeof(struct journal_header));
+        memcpy(h->magic, JOURNAL_MAGIC, sizeof(h->magic));
+        if (stat(filename, &st) == -1) {
+                h->size = -1;
+                return;
+        }
+
+        h->dev = st.st_dev;
+        h->ino = st.st_ino;
+        h->size = st.st_size;
+        h->mtime_sec = st.st_mtim.tv_sec;
+        h->mtime_nsec = st.st_mtim.tv_nsec;
+}
+
+/* Takes the pending records to j->out. return their length */
+static size_t
+journal_take(struct journal *j) {
+        char *p;
+        size_t cap;
+        size_t n;
+
+        pthread_mutex_lock(&j->lock);
+        p = j->out;
+        cap = j->out_cap;
+        j->out = j->pending;
+        j->out_cap = j->pending_cap;
+        n = j->npending;
+        j->pending = p;
+        j->pending_cap = cap;
+        j->npending = 0;
+        pthread_mutex_unlock(&j->lock);
+
+        return n;
+}
+
+/* Writes the pending records; syncs them if sync is set. Called with io held. */
+static int
+journal_write(struct journal *j, int sync) {
+        struct iovec iov;
+        size_t n = journal_take(j);
+
+        if (n == 0)
+                return 0;
+
+        iov.iov_base = j->out;
+        iov.iov_len = n;
+        if (write_all(j->fd, &iov, 1) == -1 || (sync && fdatasync(j->fd) == -1))
+                return -1;
+
+        pthread_mutex_lock(&j->lock);
+        j->commits++;
+        pthread_mutex_unlock(&j->lock);
+        return 0;
+}
+
+/* Group commit: the records of the last JOURNAL_COMMIT_MS in one go. */
+static void *
+journal_run(void *arg) {
+        struct journal *j = arg;
+        struct timespec t;
+
+        pthread_mutex_lock(&j->lock);
+        while (!j->stop) {
+                clock_gettime(CLOCK_REALTIME, &t);
+                t.tv_nsec += JOURNAL_COMMIT_MS * 1000000L;
+                t.tv_sec += t.tv_nsec / 1000000000L;
+                t.tv_nsec %= 1000000000L;
+
+                while (!j->stop && pthread_cond_timedwait(&j->wake, &j->lock, &t) != ETIMEDOUT)
+                        ;
+                if (j->stop || j->npending == 0)
+                        continue;
+
+                pthread_mutex_unlock(&j->lock);
+                pthread_mutex_lock(&j->io);
+                journal_write(j, 1);
+                pthread_mutex_unlock(&j->io);
+                pthread_mutex_lock(&j->lock);
+        }
+        pthread_mutex_unlock(&j->lock);
+
+        return NULL;
+}
+
+/* Starts the writer of journal name, open as fd with length bytes of records. */
+static struct journal *
+journal_start(char *name, int fd, off_t length) {
+        struct journal *j = calloc(1, sizeof(struct journal));
+
+        if (j == NULL)
+                die("journal");
+
+        j->name = name;
+        j->fd = fd;
+        j->length = length;
+        pthread_mutex_init(&j->lock, NULL);
+        pthread_mutex_init(&j->io, NULL);
+        pthread_cond_init(&j->wake, NULL);
+
+        if (pthread_create(&j->thread, NULL, journal_run, j) != 0)
+                die("journal thread");
+
+        return j;
+}
+
+/* A new, empty journal for the edits of filename. return NULL if it cannot be made */
+static struct journal *
+journal_create(const char *filename) {
+        struct journal_header h;
+        char *name = journal_name(filename);
+        int fd;
+
+        if (name == NULL)
+                return NULL;
+
+        fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        if (fd == -1) {
+                free(name);
+                return NULL;
+        }
+
+        journal_header_init(&h, filename);
+        if (write(fd, &h, sizeof(h)) != sizeof(h)) {
+                close(fd);
+                unlink(name);
+                free(name);
+                return NULL;
+        }
+
+        return journal_start(name, fd, 0);
+}
+
+/* Appends v to p as a varint. return its length */
+static int
+journal_put_varint(char *p, unsigned int v) {
+        int n = 0;
+
+        while (v >= 0x80) {
+                p[n++] = (char) (v | 0x80);
+                v >>= 7;
+        }
+        p[n++] = (char) v;
+
+        return n;
+}
+
+/**
+ * Adds an edit of E to its journal, which is made by the first one.
+ * len bytes of s are kept for the inserts.
+ */
+void
+journal_record(int op, int row, int at, const char *s, int len) {
+        const char *filename = E->absolute_filename != NULL ? E->absolute_filename : E->filename;
+        struct timespec start;
+        struct journal *j;
+        char rec[JOURNAL_RECORD_MAX];
+        size_t n;
+        size_t bytes;
+
+        if (journal_replaying || journal_paused || E->no_journal || filename == NULL)
+                return;
+
+        if (E->journal == NULL) {
+                E->journal = journal_create(filename);
+                if (E->journal == NULL) {
+                        E->no_journal = 1;
+                        return;
+                }
+        }
+        j = E->journal;
+
+        if (E->debug & DEBUG_JOURNAL)
+                clock_gettime(CLOCK_MONOTONIC, &start);
+
+        bytes = op == JOURNAL_INSERT_BYTES || op == JOURNAL_INSERT_ROW || op == JOURNAL_INSERT_TEXT ? len : 0;
+        rec[0] = op;
+        n = 1;
+        n += journal_put_varint(rec + n, row);
+        n += journal_put_varint(rec + n, at);
+        n += journal_put_varint(rec + n, len);
+
+        pthread_mutex_lock(&j->lock);
+        if (j->npending + n + bytes > j->pending_cap) {
+                size_t cap = j->pending_cap ? j->pending_cap * 2 : 4096;
+                while (cap < j->npending + n + bytes)
+                        cap *= 2;
+                j->pending = realloc(j->pending, cap);
+                if (j->pending == NULL)
+                        die("journal");
+                j->pending_cap = cap;
+        }
+        memcpy(j->pending + j->npending, rec, n);
+        if (bytes > 0)
+                memcpy(j->pending + j->npending + n, s, bytes);
+        j->npending += n + bytes;
+        pthread_mutex_unlock(&j->lock);
+
+        j->length += n + bytes;
+        j->records++;
+
+        if (E->debug & DEBUG_JOURNAL)
+                j->ns += elapsed_since(&start) * 1e9;
+}
+
+/**
+ * The edits until journal_resume() are not recorded: the caller has
+ * recorded them as one, such as JOURNAL_INSERT_TEXT for a paste.
+ */
+void
+journal_pause() {
+        journal_paused = 1;
+}
+
+void
+journal_resume() {
+        journal_paused = 0;
+}
+
+/* A save takes its snapshot: the records from here on are not in it. */
+void
+journal_mark(struct journal *j) {
+        j->mark = j->length;
+}
+
+/**
+ * The buffer was saved to filename from the snapshot taken at the mark,
+ * and edited since. The journal becomes one of those edits on the saved
+ * file: a new one, renamed over the journal of filename.
+ *
+ * return 0 ok, -1 error (the journal is as it was)
+ */
+int
+journal_rebase(struct journal *j, const char *filename) {
+        struct journal_header h;
+        char *name = journal_name(filename);
+        char *tmpname = NULL;
+        char *buf = NULL;
+        size_t len = j->length - j->mark;
+        size_t done = 0;
+        int fd = -1;
+
+        if (name == NULL)
+                return -1;
+
+        pthread_mutex_lock(&j->io);
+        if (journal_write(j, 0) == -1 || (buf = malloc(len > 0 ? len : 1)) == NULL)
+                goto fail;
+
+        while (done < len) {
+                ssize_t r = pread(j->fd, buf + done, len - done, sizeof(h) + j->mark + done);
+                if (r <= 0)
+                        goto fail;
+                done += r;
+        }
+
+        tmpname = malloc(strlen(name) + 8);
+        if (tmpname == NULL)
+                goto fail;
+        sprintf(tmpname, "%s.XXXXXX", name);
+        fd = mkstemp(tmpname);
+        if (fd == -1)
+                goto fail;
+
+        journal_header_init(&h, filename);
+        if (write(fd, &h, sizeof(h)) != sizeof(h)
+                || write(fd, buf, len) != (ssize_t) len
+                || fdatasync(fd) == -1
+                || rename(tmpname, name) == -1) {
+                unlink(tmpname);
+                goto fail;
+        }
+
+        if (strcmp(name, j->name) != 0)
+                unlink(j->name); /* Saved as another file. */
+        close(j->fd);
+        free(j->name);
+        j->fd = fd;
+        j->name = name;
+        j->length = len;
+        j->mark = 0;
+        pthread_mutex_unlock(&j->io);
+
+        free(tmpname);
+        free(buf);
+        return 0;
+
+fail:
+        pthread_mutex_unlock(&j->io);
+        if (fd != -1)
+                close(fd);
+        free(tmpname);
+        free(buf);
+        free(name);
+        return -1;
+}
+
+/* Stops the writer and frees j; the journal file is removed unless keep is set. */
+void
+journal_free(struct journal *j, int keep) {
+        pthread_mutex_lock(&j->lock);
+        j->stop = 1;
+        pthread_cond_signal(&j->wake);
+        pthread_mutex_unlock(&j->lock);
+        pthread_join(j->thread, NULL);
+
+        if (keep)
+                journal_write(j, 1);
+        close(j->fd);
+        if (!keep)
+                unlink(j->name);
+
+        pthread_mutex_destroy(&j->lock);
+        pthread_mutex_destroy(&j->io);
+        pthread_cond_destroy(&j->wake);
+        free(j->pending);
+        free(j->out);
+        free(j->name);
+        free(j);
+}
+
+/* Reads a varint at *p (before end) to *v. return 0 ok, -1 cut short or too big */
+static int
+journal_get_varint(const char **p, const char *end, int *v) {
+        unsigned long long x = 0;
+        int shift = 0;
+
+        while (*p < end && shift < 35) {
+                unsigned char c = *(*p)++;
+
+                x |= (unsigned long long) (c & 0x7f) << shift;
+                if (!(c & 0x80)) {
+                        if (x > INT_MAX)
+                                return -1;
+                        *v = (int) x;
+                        return 0;
+                }
+                shift += 7;
+        }
+
+        return -1;
+}
+
+/**
+ * Redoes the records in buf[0..len[ on the rows of E. A record cut short
+ * by the crash, or one that does not fit the rows, ends the replay.
+ *
+ * return the length of the records redone; *last is the row of the last one
+ */
+static size_t
+journal_replay(const char *buf, size_t len, long *n, int *last) {
+        const char *p = buf;
+        const char *end = buf + len;
+
+        journal_replaying = 1;
+        while (p < end) {
+                const char *rec = p;
+                int op = (unsigned char) *p++;
+                int row, at, l;
+                int bytes;
+
+                if (journal_get_varint(&p, end, &row) == -1
+                        || journal_get_varint(&p, end, &at) == -1
+                        || journal_get_varint(&p, end, &l) == -1) {
+                        p = rec;
+                        break;
+                }
+
+                bytes = op == JOURNAL_INSERT_BYTES || op == JOURNAL_INSERT_ROW || op == JOURNAL_INSERT_TEXT ? l : 0;
+                if (end - p < bytes || editor_row_redo(op, row, at, p, l) == -1) {
+                        p = rec;
+                        break;
+                }
+                p += bytes;
+                *last = row;
+                (*n)++;
+        }
+        journal_replaying = 0;
+
+        return p - buf;
+}
+
+/**
+ * Offers to replay the journal of filename, just opened in E, if there
+ * is one for the file as it is on the disk; a journal of some other
+ * version of it is removed. The journal goes on with the edits to come.
+ *
+ * return 1 replayed, 0 none (or not wanted), -1 error
+ */
+int
+journal_recover(const char *filename) {
+        struct journal_header h, want;
+        struct stat st;
+        char *name = filename != NULL ? journal_name(filename) : NULL;
+        char *answer;
+        char *buf;
+        size_t len;
+        size_t done;
+        long n = 0;
+        int last = 0;
+        int fd;
+
+        if (name == NULL)
+                return 0;
+
+        fd = open(name, O_RDWR);
+        if (fd == -1) {
+                free(name);
+                return 0;
+        }
+
+        journal_header_init(&want, filename);
+        if (fstat(fd, &st) == -1 || (size_t) st.st_size <= sizeof(h)
+                || read(fd, &h, sizeof(h)) != sizeof(h)
+                || memcmp(&h, &want, sizeof(h)) != 0)
+                goto drop;
+
+        answer = editor_prompt("Unsaved edits of this file were found. Recover them (y/n)? %s", NULL);
+        if (answer == NULL || (answer[0] != 'y' && answer[0] != 'Y')) {
+                free(answer);
+                goto drop;
+        }
+        free(answer);
+
+        len = st.st_size - sizeof(h);
+        buf = malloc(len);
+        if (buf == NULL) {
+                close(fd);
+                free(name);
+                return -1;
+        }
+        for (done = 0; done < len; ) {
+                ssize_t r = read(fd, buf + done, len - done);
+                if (r <= 0)
+                        break;
+                done += r;
+        }
+
+        /* All the rows first: the edits may be anywhere. */
+        editor_load_upto(INT_MAX);
+        done = journal_replay(buf, done, &n, &last);
+        free(buf);
+
+        /* Appended to after the records redone; the rest, if any, was cut short. */
+        if (ftruncate(fd, sizeof(h) + done) == -1 || lseek(fd, 0, SEEK_END) == -1) {
+                close(fd);
+                unlink(name);
+                free(name);
+                return -1;
+        }
+        E->journal = journal_start(name, fd, done);
+
+        E->cy = last < E->numrows ? last : E->numrows;
+        E->cx = 0;
+        editor_set_status_message("Recovered %ld edits.", n);
+        return 1;
+
+drop:
+        close(fd);
+        unlink(name);
+        free(name);
+        return 0;
+}
@@ -0,0 +1,86 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+/**
+        journal.h
+
+        The edits of a buffer not saved yet, kept on the disk so that a
+        crash does not lose them. Every change of the rows (see row.c) is
+        appended to <file>.kilo-edits as a small binary record. Records
+        are gathered in memory; a thread writes and syncs them every
+        JOURNAL_COMMIT_MS, one write and one fdatasync() for all the edits
+        in that time.
+
+        The journal goes away when the buffer is saved (or closed, or the
+        editor quit, with nothing unsaved). If it is still there when the
+        file is opened next, and is for this very file, replaying it is
+        offered (see journal_recover()).
+*/
+
+#define JOURNAL_SUFFIX ".kilo-edits"
+#define JOURNAL_MAGIC "KILOEDT1"
+#define JOURNAL_COMMIT_MS 200
+
+enum journal_op {
+        JOURNAL_INSERT_BYTES = 1,
+        JOURNAL_DELETE_BYTES,
+        JOURNAL_INSERT_ROW,
+        JOURNAL_DELETE_ROW,
+        JOURNAL_INSERT_TEXT     /* At row and at, lines separated by '\n' (a paste). */
+};
+
+/* The file the records are edits of; size is -1 if there was none. */
+struct journal_header {
+        char magic[8];
+        uint64_t dev;
+        uint64_t ino;
+        int64_t size;
+        int64_t mtime_sec;
+        int64_t mtime_nsec;
+};
+
+/* Followed by records: the op byte, then row, at and len as varints, then len bytes if an insert. */
+
+/* The longest record with no bytes: the op and three varints. */
+#define JOURNAL_RECORD_MAX 16
+
+struct journal {
+        pthread_t thread;
+        pthread_mutex_t lock;
+        pthread_cond_t wake;    /* Signalled to stop the thread. */
+        pthread_mutex_t io;     /* Held while the file is written. */
+        char *name;
+        int fd;
+
+        /* Shared, under lock. */
+        char *pending;          /* Records not written yet. */
+        size_t npending;
+        size_t pending_cap;
+        int stop;
+        long commits;
+
+        /* The writer's, under io. */
+        char *out;
+        size_t out_cap;
+
+        /* The main thread's. */
+        off_t length;           /* Of the records, written or not. */
+        off_t mark;             /* length when a save took its snapshot. */
+        long records;
+        double ns;              /* Spent in journal_record() (with --debug 32). */
+};
+
+void journal_record(int op, int row, int at, const char *s, int len);
+void journal_pause();
+void journal_resume();
+void journal_mark(struct journal *j);
+int journal_rebase(struct journal *j, const char *filename);
+void journal_free(struct journal *j, int keep);
+int journal_recover(const char *filename);
+
+#endif
@@ -1,22 +1,202 @@
+#define _GNU_SOURCE /* memmem() */
 #include "key.h"
 
 /* Defined in config.h */
 extern struct editor_config *E;
 
-/** key_read() */
+/* Read past the end of a paste, to be read as keys. */
+static char key_unread[KEY_PASTE_CHUNK]; 
+static int key_unread_start; 
+static int key_unread_len; 
+
+/* The text of the last bracketed paste. */
+static char *paste; 
+static size_t paste_len; 
+static size_t paste_size; 
+static int paste_open;  /* Its end has not come yet: what follows is more of it. */
+static int paste_more;  /* It goes on with the text of the last one, cut short. */
+static int paste_cr;    /* It ended in '\r': a '\n' next is the same line end. */
+
+/* At most n bytes of input: what was read ahead first. */
+static ssize_t
+key_input(char *buf, size_t n) {
+	if (key_unread_len > 0) {
+		if (n > (size_t) key_unread_len)
+			n = key_unread_len; 
+		memcpy(buf, &key_unread[key_unread_start], n); 
+		key_unread_start += n; 
+		key_unread_len -= n; 
+		return n; 
+	}
+
+	return read(STDIN_FILENO, buf, n); 
+}
+
+/* Whether a key is there to be read without waiting. */
+int
+key_pending() {
+	struct pollfd pfd = { STDIN_FILENO, POLLIN, 0 }; 
+
+	return key_unread_len > 0 || poll(&pfd, 1, 0) > 0; 
+}
+
+/**
+ * The text of the paste PASTE_KEY was returned for; its lines end in
+ * '\n'. *more is set if it goes on with the text of the last one, which
+ * was cut short by a pause.
+ */
+char *
+key_paste(size_t *len, int *more) {
+	*len = paste_len; 
+	*more = paste_more; 
+	return paste; 
+}
+
+/* Makes "\r\n" and '\r' (as the terminal sends Enter) '\n', even if cut between two chunks. */
+static void
+key_paste_lines() {
+	size_t n = 0; 
+	size_t i; 
+
+	for (i = 0; i < paste_len; i++) {
+		char c = paste[i]; 
+
+		if (c == '\n' && paste_cr) {
+			paste_cr = 0; 
+			continue; 
+		}
+		paste_cr = c == '\r'; 
+		paste[n++] = c == '\r' ? '\n' : c; 
+	}
+	paste_len = n; 
+}
+
+/**
+ * Puts back the last bytes of the paste if they are the start of end,
+ * which may be cut in two: they are read again with the rest of it.
+ */
+static void
+key_hold_end(const char *end) {
+	size_t k = strlen(end) - 1; 
+
+	for (; k > 0; k--)
+		if (paste_len >= k && memcmp(&paste[paste_len - k], end, k) == 0)
+			break; 
+
+	paste_len -= k; 
+	memcpy(key_unread, &paste[paste_len], k); 
+	key_unread_start = 0; 
+	key_unread_len = k; 
+}
+
+/**
+ * Reads the text of a bracketed paste up to its end, ESC [ 2 0 1 ~, in
+ * chunks instead of a key at a time. What comes after the end is kept
+ * for key_read(). If the end is not there in KEY_PASTE_WAIT_MS, the text
+ * so far is returned and the paste left open: the next key_read() goes
+ * on with it (more), so the rest is not taken as keys. If nothing more
+ * comes in that wait either, or the input ends, the end was lost: the
+ * paste is over and keys are read again.
+ */
+static void
+key_read_paste(int more) {
+	const char *end = "\x1b[201~"; 
+	size_t endlen = strlen(end); 
+	size_t got = 0;         /* Read from the terminal, not put back. */
+	size_t from; 
+	char *found; 
+
+	paste_len = 0; 
+	paste_more = more; 
+	paste_open = 1; 
+	if (!more)
+		paste_cr = 0; 
+	while (1) {
+		struct pollfd pfd = { STDIN_FILENO, POLLIN, 0 }; 
+		ssize_t n = -1; 
+		int ready; 
+
+		if (paste_size - paste_len < KEY_PASTE_CHUNK) {
+			paste_size = paste_size ? 2 * paste_size : 4 * KEY_PASTE_CHUNK; 
+			paste = realloc(paste, paste_size); 
+			if (paste == NULL)
+				die("key_read_paste"); 
+		}
+
+		ready = key_unread_len > 0 ? 1 : poll(&pfd, 1, KEY_PASTE_WAIT_MS); 
+		if (ready == -1 && errno == EINTR) 
+			continue; /* A resize. */
+		if (ready > 0) {
+			int fresh = key_unread_len == 0; 
+
+			n = key_input(&paste[paste_len], KEY_PASTE_CHUNK); 
+			if (n == -1 && (errno == EINTR || errno == EAGAIN))
+				continue; 
+			if (n == -1) 
+				die("read"); 
+			if (fresh)
+				got += n; 
+		}
+		if (ready <= 0 || n == 0) {
+			key_hold_end(end); 
+			if (n == 0 || (more && got == 0)) {
+				key_unread_len = 0; /* What there was of the end. */
+				paste_open = 0; 
+			}
+			break; 
+		}
+
+		from = paste_len > endlen ? paste_len - endlen : 0; 
+		paste_len += n; 
+		found = memmem(&paste[from], paste_len - from, end, endlen); 
+		if (found != NULL) {
+			key_unread_start = 0; 
+			key_unread_len = &paste[paste_len] - (found + endlen); 
+			memcpy(key_unread, found + endlen, key_unread_len); 
+			paste_len = found - paste; 
+			paste_open = 0; 
+			break; 
+		}
+	}
+
+	key_paste_lines(); 
+}
+
+/** 
+ * key_read() 
+ *
+ * While a file is loaded or saved in the background LOAD_KEY is returned
+ * if no key is pressed in KEY_LOAD_WAIT_MS, so the caller can take more
+ * rows (or tell the save is done). Piped input waits for rows to take.
+ */
 int 
 key_read() {
   	int nread;
   	char c;
 
-	while ((nread = read(STDIN_FILENO, &c, 1)) != 1) {
+	if (E->loader != NULL || E->save != NULL) {
+		struct pollfd pfd = { STDIN_FILENO, POLLIN, 0 }; 
+
+		/* A stream with nothing new to show is waited on, not redrawn. */
+		while (key_unread_len == 0 && poll(&pfd, 1, KEY_LOAD_WAIT_MS) == 0)
+			if (E->save != NULL || loader_ready(E->loader))
+				return LOAD_KEY; 
+	}
+
+	if (paste_open) {
+		key_read_paste(1); 
+		if (paste_open || paste_len > 0)
+			return PASTE_KEY; 
+	}
+
+	while ((nread = key_input(&c, 1)) != 1) {
 		if (nread == -1 && errno != EAGAIN) die("read");
 	}
 
   	if (c == '\x1b') {
-  		char seq[3];
+  		char seq[5];
   		
-  		if (read(STDIN_FILENO, &seq[0], 1) != 1) return c; //'\x1b'; /* vy!c?*/
+  		if (key_input(&seq[0], 1) != 1) return c; //'\x1b'; /* vy!c?*/
   	
   		if (seq[0] == 'v' || seq[0] == 'V') { 
   			return PAGE_UP; 
@@ -36,11 +216,11 @@ key_read() {
                         return GOTO_END_OF_FILE_KEY;
                 }
                 
-  		if (read(STDIN_FILENO, &seq[1], 1) != 1) return c; //'\x1b'; /*ditto*/
+  		if (key_input(&seq[1], 1) != 1) return c; //'\x1b'; /*ditto*/
 
   		if (seq[0] == '[') {
   			if (seq[1] >= '0' && seq[1] <= '9') {
-  				if (read(STDIN_FILENO, &seq[2], 1) != 1) return c; 
+  				if (key_input(&seq[2], 1) != 1) return c; 
   				if (seq[2] == '~') { // <esc>5~ and <esc>6~ 
   					switch (seq[1]) {
   						case '1': return HOME_KEY;
@@ -51,6 +231,13 @@ key_read() {
   						case '7': return HOME_KEY;
   						case '8': return END_KEY;
   					}
+  				} else if (seq[1] == '2' && seq[2] == '0') { // <esc>[200~ starts a paste.
+  					if (key_input(&seq[3], 1) != 1 || key_input(&seq[4], 1) != 1) 
+  						return c; 
+  					if (seq[3] == '0' && seq[4] == '~') {
+  						key_read_paste(0); 
+  						return PASTE_KEY; 
+  					}
   				}
   			} else {
   				switch (seq[1]) {
@@ -111,10 +298,19 @@ key_normalize(int c) {
 	return c; 
 }
 
+/**
+ * The last row the cursor can go to: the line after the last row, or the
+ * last row of a file still loading, as the rows to come go after it.
+ */
+int
+key_last_row() {
+	return E->loader != NULL && E->numrows > 0 ? E->numrows - 1 : E->numrows; 
+}
+
 void 
 key_move_cursor(int key) {
 	int rowlen;
-	erow *row = (E->cy >= E->numrows) ? NULL : &E->row[E->cy];
+	erow *row = editor_row_at(E->cy);
 
   	switch (key) {
         case ARROW_LEFT:
@@ -125,14 +321,14 @@ key_move_cursor(int key) {
 
                 } else if (E->cy > 0) {
         	       E->cy--;
-       		       E->cx = E->row[E->cy].size;
+       		       E->cx = editor_row_at(E->cy)->size;
                 }
                 break;
         case ARROW_RIGHT:
                 //if (E.cx != E.screencols - 1)
                 if (row && E->cx < row->size) {
       		        E->cx++;
-                } else if (row && E->cx == row->size) {
+                } else if (row && E->cx == row->size && E->cy < key_last_row()) {
         	       E->cy++;
         	       E->cx = 0;
                 }
@@ -140,17 +336,19 @@ key_move_cursor(int key) {
         case ARROW_UP:
                 if (E->cy != 0) {
       		        E->cy--;
-                        if (E->cx > E->row[E->cy].size) {
-                                E->cx = E->row[E->cy].size;
+                        row = editor_row_at(E->cy); 
+                        if (E->cx > row->size) {
+                                E->cx = row->size;
                                 E->coloff = 0;
                         }
                 }
                 break;
         case ARROW_DOWN:
-                if (E->cy < E->numrows) {
+                if (E->cy < key_last_row()) {
       		        E->cy++;                        
-                        if (E->cx > E->row[E->cy].size) {
-                                E->cx = E->row[E->cy].size;
+                        row = editor_row_at(E->cy); 
+                        if (row != NULL && E->cx > row->size) {
+                                E->cx = row->size;
                                 E->coloff = 0;
                         }
                 }      
@@ -159,7 +357,7 @@ key_move_cursor(int key) {
                 break;
   	}
 
-        row = (E->cy >= E->numrows) ? NULL : &E->row[E->cy];
+        row = editor_row_at(E->cy);
   	rowlen = row ? row->size : 0;
   	if (E->cx > rowlen) {
                 E->cx = rowlen;
@@ -5,8 +5,10 @@
 */
 
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <poll.h>
 #include "terminal.h"
 #include "row.h"
 
@@ -21,6 +23,14 @@ to switch between lowercase and uppercase.)
 */
 #define CTRL_KEY(k) ((k) & 0x1f)
 
+/* How long key_read() waits for a key before returning LOAD_KEY. */
+#define KEY_LOAD_WAIT_MS 10
+/* The longest keys already typed (or pasted) are taken for before the screen is drawn again. */
+#define KEY_BATCH_MS 50
+/* A bracketed paste is read this much at a time, and given up if nothing more comes in KEY_PASTE_WAIT_MS. */
+#define KEY_PASTE_CHUNK 4096
+#define KEY_PASTE_WAIT_MS 1000
+
 enum editor_key {
 	BACKSPACE = 127, 
 	ARROW_LEFT = 1000,
@@ -55,10 +65,15 @@ enum editor_key {
         OPEN_FILE_KEY,          /* Ctrl-O */
         GOTO_BEGINNING_OF_FILE_KEY, /* Esc-A */
         GOTO_END_OF_FILE_KEY,   /* Esc-E */
+        LOAD_KEY,               /* No key: time to load more rows (see key_read()). */
+        PASTE_KEY,              /* A bracketed paste: the text is in key_paste(). */
 };
 
 int key_read();
+int key_pending();
+char *key_paste(size_t *len, int *more);
 int key_normalize(int c);
+int key_last_row();
 void key_move_cursor(int key); 
 
 #endif
@@ -32,6 +32,9 @@
 #include "kilo.h"
 #include "output.h"
 #include "options.h"
+#include "file.h"
+#include "opener.h"
+#include "uring.h"
 
 /** buffers **/
 
@@ -49,23 +52,66 @@ handle_resize(int dummy) {
                         
         editor_scroll();
         editor_set_status_message(msg);
+        screen_invalidate();
         editor_refresh_screen();
 }
 
+/* Piped input (see terminal_take_stdin()); -1 if none. */
+static int piped_input = -1; 
+
+/* A file of the command line; - is the piped input. */
+static void
+open_argument_file(char *filename) {
+        if (strcmp(filename, "-")) {
+                command_open_file(filename); 
+        } else if (piped_input != -1) {
+                editor_open_stream(piped_input); 
+                piped_input = -1; 
+        } else {
+                editor_set_status_message("-: no piped input."); 
+        }
+}
+
 void 
 open_argument_files(int argc, char **argv, int index) {
         struct command_str *c = command_get_by_key(COMMAND_OPEN_FILE);
+        struct open_job **jobs; 
+        int i; 
 
         if (index >= argc)
                 return; 
                 
         /* We have already called init_buffer() once before argument parsing. */
-        command_open_file(argv[index]);
-        
-        while (++index < argc) {
-                (void) create_buffer(BUFFER_TYPE_FILE, 0, c->success, COMMAND_NO_CMD);
-                command_open_file(argv[index]);
+        if (argc - index == 1) {
+                open_argument_file(argv[index]); 
+                return; 
         }
+
+        /* 
+         * Many files are read in parallel (see opener.h); the buffers are
+         * linked in order meanwhile. The last one is shown: it is finished
+         * now, the others when first switched to.
+         */
+        jobs = malloc((argc - index) * sizeof(struct open_job *)); 
+        if (jobs == NULL)
+                die("open_argument_files"); 
+
+        for (i = index; i < argc; i++) {
+                if (i > index)
+                        (void) create_buffer(BUFFER_TYPE_FILE, 0, c->success, COMMAND_NO_CMD);
+                if (!strcmp(argv[i], "-")) {
+                        jobs[i - index] = NULL; 
+                        open_argument_file(argv[i]); 
+                        continue; 
+                }
+                E->filename = strdup(argv[i]); 
+                E->basename = editor_basename(argv[i]); 
+                E->opening = jobs[i - index] = open_job_new(argv[i]); 
+        }
+
+        /* The array is the opener's while its threads run: never freed. */
+        opener_start(jobs, argc - index); 
+        editor_open_pending(); 
 }
 
 
@@ -73,7 +119,7 @@ void
 parse_options(int argc, char **argv) {
         int file_index = 0; // Start index of file names.
          
-        Option *list = options_parse(argc, argv, "version|v,help|h,debug|d:i,ascii|a", &file_index);
+        Option *list = options_parse(argc, argv, "version|v,help|h,debug|d:i,ascii|a,readonly|r,fsync|f:s,gzip-level|z:i,io|i:s", &file_index);
         
         while (list != NULL) { // options_parse can return NULL
                 if (list->is_set) {
@@ -83,6 +129,41 @@ parse_options(int argc, char **argv) {
                         } else if (! strcmp(list->long_option, "ascii")
                                 || ! strcmp(list->short_option, "a")) {
                                 E->ascii_only = 1;                
+                        } else if (! strcmp(list->long_option, "readonly")
+                                || ! strcmp(list->short_option, "r")) {
+                                open_readonly = 1; 
+                        } else if (! strcmp(list->long_option, "fsync")
+                                || ! strcmp(list->short_option, "f")) {
+                                if (! strcmp(list->value.string, "none")) {
+                                        fsync_policy = FSYNC_NONE;
+                                } else if (! strcmp(list->value.string, "data")) {
+                                        fsync_policy = FSYNC_DATA;
+                                } else if (! strcmp(list->value.string, "full")) {
+                                        fsync_policy = FSYNC_FULL;
+                                } else {
+                                        disable_raw_mode();
+                                        fprintf(stderr, "kilo: --fsync is none, data or full\n");
+                                        exit(1);
+                                }
+                        } else if (! strcmp(list->long_option, "gzip-level")
+                                || ! strcmp(list->short_option, "z")) {
+                                gzip_level = list->value.numeric; 
+                                if (gzip_level < 1 || gzip_level > 9) {
+                                        disable_raw_mode();
+                                        fprintf(stderr, "kilo: --gzip-level is 1 to 9\n");
+                                        exit(1);
+                                }
+                        } else if (! strcmp(list->long_option, "io")
+                                || ! strcmp(list->short_option, "i")) {
+                                if (! strcmp(list->value.string, "sync")) {
+                                        io_backend = IO_SYNC;
+                                } else if (! strcmp(list->value.string, "uring")) {
+                                        io_backend = IO_URING;
+                                } else {
+                                        disable_raw_mode();
+                                        fprintf(stderr, "kilo: --io is sync or uring\n");
+                                        exit(1);
+                                }
                         } else if (! strcmp(list->long_option, "version") 
                                 || ! strcmp(list->short_option, "v")) {
                                 print_version();
@@ -98,6 +179,8 @@ parse_options(int argc, char **argv) {
                 
        if (file_index < argc)         
                 open_argument_files(argc, argv, file_index);
+       else if (piped_input != -1) /* cmd | kilo */
+                open_argument_file("-"); 
 }       
 
 #if 0
@@ -134,11 +217,15 @@ old_parse_options(int argc, char **argv) {
 
 int 
 main(int argc, char **argv) {
+	piped_input = terminal_take_stdin(); 
 	enable_raw_mode();
 	       
         buffer = create_buffer(BUFFER_TYPE_FILE, 0, "", COMMAND_NO_CMD);
 	
         init_editor();
+        fsync_policy = DEFAULT_FSYNC_POLICY;
+        gzip_level = DEFAULT_GZIP_LEVEL;
+        io_backend = DEFAULT_IO_BACKEND;
 	parse_options(argc, argv); // Also opens file.
 
 	editor_set_status_message(WELCOME_STATUS_BAR);
@@ -146,8 +233,20 @@ main(int argc, char **argv) {
         signal(SIGWINCH, handle_resize);
 
 	while (1) {
+		struct timespec start; 
+
 		editor_refresh_screen();
-		editor_process_keypress();
+
+		/*
+		 * Keys that came together (a paste) are drawn once, but not waited on
+		 * for too long. The view still follows each of them: Page Down moves
+		 * from the rowoff the previous key left.
+		 */
+		clock_gettime(CLOCK_MONOTONIC, &start); 
+		do {
+			editor_process_keypress();
+			editor_scroll(); 
+		} while (key_pending() && elapsed_since(&start) * 1000 < KEY_BATCH_MS); 
 	}
 
 	return 0;
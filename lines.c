@@ -0,0 +1,438 @@
+#include <stdlib.h>
+#include <string.h>
+#include "data.h"
+#include "lines.h"
+#include "terminal.h"
+
+/**
+        lines.c
+
+        Blocks fill up to LINE_BLOCK_SIZE rows. A full block is split in
+        two when a row is inserted into it, except at the very end where
+        a new block is started (so a loaded file has full blocks). Empty
+        blocks are removed. Splitting or removing a block renumbers the
+        blocks after it and rebuilds the tree; that happens at most once
+        per LINE_BLOCK_SIZE edits.
+*/
+
+void
+line_index_init(struct line_index *li) {
+        li->blocks = NULL;
+        li->nblocks = 0;
+        li->capacity = 0;
+        li->tree = NULL;
+        li->numrows = 0;
+        li->hint_pos = -1;
+        li->hint_start = 0;
+}
+
+/* The rows have to be freed (editor_free_row()) by the caller. */
+void
+line_index_free(struct line_index *li) {
+        int i;
+
+        for (i = 0; i < li->nblocks; i++)
+                free(li->blocks[i]);
+
+        free(li->blocks);
+        free(li->tree);
+        line_index_init(li);
+}
+
+static void
+tree_add(struct line_index *li, int pos, int delta) {
+        int i;
+
+        for (i = pos + 1; i <= li->nblocks; i += i & -i)
+                li->tree[i] += delta;
+}
+
+/* Number of rows in blocks [0, pos[. */
+static int
+tree_prefix(struct line_index *li, int pos) {
+        int sum = 0;
+        int i;
+
+        for (i = pos; i > 0; i -= i & -i)
+                sum += li->tree[i];
+
+        return sum;
+}
+
+static void
+tree_rebuild(struct line_index *li) {
+        int i;
+
+        for (i = 1; i <= li->nblocks; i++)
+                li->tree[i] = li->blocks[i - 1]->count;
+
+        for (i = 1; i <= li->nblocks; i++) {
+                int parent = i + (i & -i);
+                if (parent <= li->nblocks)
+                        li->tree[parent] += li->tree[i];
+        }
+
+        li->hint_pos = -1;
+}
+
+/**
+ * Finds the block containing row 'at' (0 <= at < numrows).
+ * Sets *start to the number of the first row in that block.
+ */
+static int
+find_block(struct line_index *li, int at, int *start) {
+        int pos = 0;
+        int sum = 0;
+        int step = 1;
+
+        if (li->hint_pos != -1 && at >= li->hint_start
+                && at < li->hint_start + li->blocks[li->hint_pos]->count) {
+                *start = li->hint_start;
+                return li->hint_pos;
+        }
+
+        while (step * 2 <= li->nblocks)
+                step *= 2;
+
+        /* Descend the tree: the last block whose prefix is <= at. */
+        for (; step > 0; step /= 2) {
+                if (pos + step <= li->nblocks && sum + li->tree[pos + step] <= at) {
+                        pos += step;
+                        sum += li->tree[pos];
+                }
+        }
+
+        li->hint_pos = pos;
+        li->hint_start = sum;
+        *start = sum;
+        return pos;
+}
+
+static struct line_block *
+alloc_block() {
+        struct line_block *b = malloc(sizeof(struct line_block)
+                                + LINE_BLOCK_SIZE * sizeof(erow));
+        if (b == NULL)
+                die("line block");
+
+        b->count = 0;
+        b->pos = 0;
+        b->rows = (erow *) (b + 1);
+        return b;
+}
+
+/* Puts b to blocks[pos]; renumbers the following blocks. */
+static void
+add_block(struct line_index *li, int pos, struct line_block *b) {
+        int i;
+
+        if (li->nblocks == li->capacity) {
+                li->capacity = li->capacity ? li->capacity * 2 : 16;
+                li->blocks = realloc(li->blocks, li->capacity * sizeof(struct line_block *));
+                li->tree = realloc(li->tree, (li->capacity + 1) * sizeof(int));
+                if (li->blocks == NULL || li->tree == NULL)
+                        die("line index");
+        }
+
+        memmove(&li->blocks[pos + 1], &li->blocks[pos],
+                (li->nblocks - pos) * sizeof(struct line_block *));
+        li->blocks[pos] = b;
+        li->nblocks++;
+
+        for (i = pos; i < li->nblocks; i++)
+                li->blocks[i]->pos = i;
+
+        if (pos == li->nblocks - 1 && b->count == 0) {
+                /* An empty block appended: only its own node is new. */
+                int n = li->nblocks;
+
+                li->tree[n] = 0;
+                for (i = n - 1; i > n - (n & -n); i -= i & -i)
+                        li->tree[n] += li->tree[i];
+        } else {
+                tree_rebuild(li);
+        }
+}
+
+static void
+remove_block(struct line_index *li, int pos) {
+        int i;
+
+        free(li->blocks[pos]);
+        memmove(&li->blocks[pos], &li->blocks[pos + 1],
+                (li->nblocks - pos - 1) * sizeof(struct line_block *));
+        li->nblocks--;
+
+        for (i = pos; i < li->nblocks; i++)
+                li->blocks[i]->pos = i;
+
+        tree_rebuild(li);
+}
+
+erow *
+line_index_get(struct line_index *li, int at) {
+        int start;
+        int pos;
+
+        if (at < 0 || at >= li->numrows)
+                return NULL;
+
+        pos = find_block(li, at, &start);
+        return &li->blocks[pos]->rows[at - start];
+}
+
+/**
+ * Makes room for a new row at 'at' (0 <= at <= numrows).
+ *
+ * return the new (zeroed) row. Pointers to the rows after it in the
+ * same block are invalidated.
+ */
+erow *
+line_index_insert(struct line_index *li, int at) {
+        struct line_block *b;
+        int start = 0;
+        int pos;
+        int i;
+        erow *row;
+
+        if (at < 0 || at > li->numrows)
+                return NULL;
+
+        if (li->nblocks == 0) {
+                add_block(li, 0, alloc_block());
+                pos = 0;
+        } else if (at == li->numrows) {
+                pos = li->nblocks - 1;
+                start = li->numrows - li->blocks[pos]->count;
+                if (li->blocks[pos]->count == LINE_BLOCK_SIZE) {
+                        /* Appending: start a new block instead of splitting. */
+                        add_block(li, ++pos, alloc_block());
+                        start = li->numrows;
+                }
+        } else {
+                pos = find_block(li, at, &start);
+        }
+
+        b = li->blocks[pos];
+
+        if (b->count == LINE_BLOCK_SIZE) {
+                struct line_block *n = alloc_block();
+                int half = LINE_BLOCK_SIZE / 2;
+
+                memcpy(n->rows, &b->rows[half], (b->count - half) * sizeof(erow));
+                n->count = b->count - half;
+                b->count = half;
+                for (i = 0; i < n->count; i++)
+                        n->rows[i].block = n;
+
+                add_block(li, pos + 1, n);
+
+                if (at - start > half) {
+                        start += half;
+                        b = n;
+                }
+                pos = b->pos;
+        }
+
+        row = &b->rows[at - start];
+        memmove(row + 1, row, (b->count - (at - start)) * sizeof(erow));
+        memset(row, 0, sizeof(erow));
+        row->block = b;
+        b->count++;
+        li->numrows++;
+        tree_add(li, pos, 1);
+
+        if (li->hint_pos > pos)
+                li->hint_pos = -1;
+
+        return row;
+}
+
+/**
+ * Makes room for n new rows at 'at' (0 <= at <= numrows) in one go. The
+ * rows after them in the block of 'at' are set aside, then that block
+ * and as many new ones as needed are filled with the new (zeroed) rows
+ * and those: the blocks are renumbered and the tree rebuilt only once.
+ * Pointers to the rows after 'at' are invalidated.
+ */
+void
+line_index_insert_rows(struct line_index *li, int at, int n) {
+        struct line_block *b;
+        erow *tail = NULL;
+        int tail_count;
+        int start = 0;
+        int nadded;
+        int pos;
+        int i;
+
+        if (at < 0 || at > li->numrows || n <= 0)
+                return;
+
+        if (li->nblocks == 0) {
+                line_index_load(li, n);
+                return;
+        }
+
+        if (at == li->numrows) {
+                pos = li->nblocks - 1;
+                start = li->numrows - li->blocks[pos]->count;
+        } else {
+                pos = find_block(li, at, &start);
+        }
+        b = li->blocks[pos];
+
+        if (b->count + n <= LINE_BLOCK_SIZE) {
+                erow *row = &b->rows[at - start];
+
+                memmove(row + n, row, (b->count - (at - start)) * sizeof(erow));
+                memset(row, 0, n * sizeof(erow));
+                for (i = 0; i < n; i++)
+                        row[i].block = b;
+                b->count += n;
+                li->numrows += n;
+                tree_add(li, pos, n);
+                if (li->hint_pos > pos)
+                        li->hint_pos = -1;
+                return;
+        }
+
+        tail_count = b->count - (at - start);
+        if (tail_count > 0) {
+                tail = malloc(tail_count * sizeof(erow));
+                if (tail == NULL)
+                        die("line index");
+                memcpy(tail, &b->rows[at - start], tail_count * sizeof(erow));
+        }
+        b->count = at - start;
+
+        /* What does not fit in b goes to new blocks, full but the last. */
+        nadded = (n + tail_count - (LINE_BLOCK_SIZE - b->count) + LINE_BLOCK_SIZE - 1) / LINE_BLOCK_SIZE;
+        if (li->nblocks + nadded > li->capacity) {
+                while (li->nblocks + nadded > li->capacity)
+                        li->capacity *= 2;
+                li->blocks = realloc(li->blocks, li->capacity * sizeof(struct line_block *));
+                li->tree = realloc(li->tree, (li->capacity + 1) * sizeof(int));
+                if (li->blocks == NULL || li->tree == NULL)
+                        die("line index");
+        }
+        memmove(&li->blocks[pos + 1 + nadded], &li->blocks[pos + 1],
+                (li->nblocks - pos - 1) * sizeof(struct line_block *));
+        for (i = 1; i <= nadded; i++)
+                li->blocks[pos + i] = alloc_block();
+        li->nblocks += nadded;
+
+        for (i = 0; i < n + tail_count; i++) {
+                erow *row;
+
+                if (b->count == LINE_BLOCK_SIZE)
+                        b = li->blocks[++pos];
+                row = &b->rows[b->count++];
+                if (i < n)
+                        memset(row, 0, sizeof(erow));
+                else
+                        *row = tail[i - n];
+                row->block = b;
+        }
+
+        for (i = 0; i < li->nblocks; i++)
+                li->blocks[i]->pos = i;
+        li->numrows += n;
+        tree_rebuild(li);
+        free(tail);
+}
+
+/**
+ * A new (zeroed) row after the last one, in O(log blocks). 
+ * Used when rows are streamed in, see loader.c.
+ */
+erow *
+line_index_append(struct line_index *li) {
+        struct line_block *b;
+        int pos = li->nblocks - 1;
+        erow *row;
+
+        if (pos < 0 || li->blocks[pos]->count == LINE_BLOCK_SIZE)
+                add_block(li, ++pos, alloc_block());
+
+        b = li->blocks[pos];
+        row = &b->rows[b->count++];
+        memset(row, 0, sizeof(erow));
+        row->block = b;
+        li->numrows++;
+        tree_add(li, pos, 1);
+
+        return row;
+}
+
+/**
+ * Makes n zeroed rows into an empty index at once: the block array is
+ * allocated and the tree built only once. Blocks are full but the last.
+ */
+void
+line_index_load(struct line_index *li, int n) {
+        int nblocks = (n + LINE_BLOCK_SIZE - 1) / LINE_BLOCK_SIZE;
+        int i;
+
+        if (li->nblocks != 0 || n <= 0)
+                return;
+
+        li->capacity = nblocks;
+        li->blocks = malloc(nblocks * sizeof(struct line_block *));
+        li->tree = malloc((nblocks + 1) * sizeof(int));
+        if (li->blocks == NULL || li->tree == NULL)
+                die("line index");
+
+        for (i = 0; i < nblocks; i++) {
+                struct line_block *b = alloc_block();
+                int j;
+
+                b->pos = i;
+                b->count = i < nblocks - 1 ? LINE_BLOCK_SIZE : n - i * LINE_BLOCK_SIZE;
+                memset(b->rows, 0, b->count * sizeof(erow));
+                for (j = 0; j < b->count; j++)
+                        b->rows[j].block = b;
+                li->blocks[i] = b;
+        }
+
+        li->nblocks = nblocks;
+        li->numrows = n;
+        tree_rebuild(li);
+}
+
+/* The row has to be freed (editor_free_row()) by the caller. */
+void
+line_index_delete(struct line_index *li, int at) {
+        struct line_block *b;
+        int start;
+        int pos;
+        erow *row;
+
+        if (at < 0 || at >= li->numrows)
+                return;
+
+        pos = find_block(li, at, &start);
+        b = li->blocks[pos];
+        row = &b->rows[at - start];
+        memmove(row, row + 1, (b->count - (at - start) - 1) * sizeof(erow));
+        b->count--;
+        li->numrows--;
+
+        if (b->count == 0) {
+                remove_block(li, pos);
+        } else {
+                tree_add(li, pos, -1);
+                if (li->hint_pos > pos)
+                        li->hint_pos = -1;
+        }
+}
+
+/* The row number of row (which must be in li). */
+int
+line_index_row_number(struct line_index *li, erow *row) {
+        struct line_block *b = row->block;
+
+        if (li->hint_pos == b->pos)
+                return li->hint_start + (row - b->rows);
+
+        return tree_prefix(li, b->pos) + (row - b->rows);
+}
@@ -0,0 +1,44 @@
+#ifndef LINES_H
+#define LINES_H
+
+/**
+        lines.h
+
+        The line index: rows are kept in fixed size blocks and a Fenwick
+        tree over the block line counts finds the block of a line number.
+        Inserting, deleting and looking up a row are O(log blocks) plus a
+        memmove of at most LINE_BLOCK_SIZE rows. The row number is not
+        stored in the row; it is derived from the block it lives in.
+*/
+
+#define LINE_BLOCK_SIZE 256
+
+struct erow;
+
+struct line_block {
+        int count;      /* Rows in use. */
+        int pos;        /* Index in line_index.blocks. */
+        struct erow *rows;
+};
+
+struct line_index {
+        struct line_block **blocks;
+        int nblocks;
+        int capacity;   /* Of blocks and tree. */
+        int *tree;      /* Fenwick tree (1-based) of line counts per block. */
+        int numrows;
+        int hint_pos;   /* Block of the last lookup, -1 = none. */
+        int hint_start; /* The first row number in that block. */
+};
+
+void line_index_init(struct line_index *li);
+void line_index_free(struct line_index *li);
+struct erow *line_index_get(struct line_index *li, int at);
+struct erow *line_index_insert(struct line_index *li, int at);
+void line_index_insert_rows(struct line_index *li, int at, int n);
+void line_index_load(struct line_index *li, int n);
+struct erow *line_index_append(struct line_index *li);
+void line_index_delete(struct line_index *li, int at);
+int line_index_row_number(struct line_index *li, struct erow *row);
+
+#endif
@@ -0,0 +1,286 @@
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "loader.h"
+#include "scan.h"
+#include "row.h"
+#include "terminal.h"
+
+/**
+        loader.c
+
+        The thread only reads the text and the shared fields; rows and
+        everything else in E are touched by the main thread alone.
+*/
+
+#define LOADER_BATCH 4096
+
+/* Publishes n line ends; called by the thread. */
+static void
+loader_publish(struct loader *l, size_t *ends, size_t n) {
+        pthread_mutex_lock(&l->lock);
+        if (l->npending + n > l->pending_cap) {
+                size_t cap = l->pending_cap ? l->pending_cap * 2 : LOADER_BATCH;
+                while (cap < l->npending + n)
+                        cap *= 2;
+                l->pending = realloc(l->pending, cap * sizeof(size_t));
+                if (l->pending == NULL)
+                        die("loader");
+                l->pending_cap = cap;
+        }
+        memcpy(&l->pending[l->npending], ends, n * sizeof(size_t));
+        l->npending += n;
+        pthread_cond_signal(&l->more);
+        pthread_mutex_unlock(&l->lock);
+}
+
+static void *
+loader_run(void *arg) {
+        struct loader *l = arg;
+        size_t pos[LOADER_BATCH];
+        size_t off = 0;
+        size_t scanned;
+        size_t found;
+        size_t k;
+        int cancel = 0;
+
+        while (off < l->len && !cancel) {
+                found = scan_find_lines(l->text + off, l->len - off, pos, LOADER_BATCH - 1, &scanned);
+                for (k = 0; k < found; k++)
+                        pos[k] += off + 1;
+                if (off + scanned == l->len && l->text[l->len - 1] != '\n')
+                        pos[found++] = l->len; /* The last line has no '\n'. */
+
+                loader_publish(l, pos, found);
+                off += scanned;
+
+                pthread_mutex_lock(&l->lock);
+                cancel = l->cancel;
+                pthread_mutex_unlock(&l->lock);
+        }
+
+        pthread_mutex_lock(&l->lock);
+        l->done = 1;
+        pthread_cond_signal(&l->more);
+        pthread_mutex_unlock(&l->lock);
+        return NULL;
+}
+
+/* Reads the stream into text as it comes; publishes the line ends read. */
+static void *
+loader_read(void *arg) {
+        struct loader *l = arg;
+        char *text = (char *) l->text;
+        size_t pos[LOADER_BATCH];
+        size_t len = 0;         /* Read so far. */
+        size_t off = 0;         /* Scanned so far. */
+        size_t scanned;
+        size_t found;
+        size_t k;
+        int cancel = 0;
+        int full = 0;
+        int err = 0;
+
+        while (!cancel) {
+                struct pollfd pfd = { l->fd, POLLIN, 0 };
+                size_t room = l->len - len;
+                ssize_t n = 0;
+
+                if (room == 0) {
+                        full = 1;
+                        break;
+                }
+
+                /* Not blocked in read(): cancel is looked at every LOADER_READ_WAIT_MS. */
+                if (poll(&pfd, 1, LOADER_READ_WAIT_MS) > 0) {
+                        n = read(l->fd, text + len, room < LOADER_READ_SIZE ? room : LOADER_READ_SIZE);
+                        if (n == 0)
+                                break;
+                        if (n == -1 && errno != EINTR && errno != EAGAIN) {
+                                err = errno;
+                                break;
+                        }
+                }
+
+                if (n > 0) {
+                        len += n;
+                        while (off < len) {
+                                found = scan_find_lines(text + off, len - off, pos, LOADER_BATCH, &scanned);
+                                for (k = 0; k < found; k++)
+                                        pos[k] += off + 1;
+                                if (found > 0)
+                                        loader_publish(l, pos, found);
+                                off += scanned;
+                        }
+                }
+
+                pthread_mutex_lock(&l->lock);
+                cancel = l->cancel;
+                pthread_mutex_unlock(&l->lock);
+        }
+
+        if (!cancel && len > 0 && text[len - 1] != '\n')
+                loader_publish(l, &len, 1); /* The last line has no '\n'. */
+
+        pthread_mutex_lock(&l->lock);
+        l->done = 1;
+        l->full = full;
+        l->err = err;
+        pthread_cond_signal(&l->more);
+        pthread_mutex_unlock(&l->lock);
+        return NULL;
+}
+
+static struct loader *
+loader_new(const char *text, size_t len, int fd, void *(*run)(void *)) {
+        struct loader *l = calloc(1, sizeof(struct loader));
+
+        if (l == NULL)
+                die("loader");
+
+        l->text = text;
+        l->len = len;
+        l->fd = fd;
+        pthread_mutex_init(&l->lock, NULL);
+        pthread_cond_init(&l->more, NULL);
+
+        if (pthread_create(&l->thread, NULL, run, l) != 0)
+                die("loader thread");
+
+        return l;
+}
+
+/* Starts loading text (len > 0 bytes, kept by the caller) as the rows of E. */
+struct loader *
+loader_start(const char *text, size_t len) {
+        return loader_new(text, len, -1, loader_run);
+}
+
+/**
+ * Starts reading the stream fd (closed by loader_free()) into text
+ * (cap bytes, kept by the caller) as the rows of E.
+ */
+struct loader *
+loader_stream(int fd, char *text, size_t cap) {
+        return loader_new(text, cap, fd, loader_read);
+}
+
+/**
+ * Takes the published line ends; waits for some if wait is set.
+ * return 0 if there are none and will be no more.
+ */
+static int
+loader_take(struct loader *l, int wait) {
+        size_t *p;
+        size_t cap;
+        int more;
+
+        pthread_mutex_lock(&l->lock);
+        while (wait && l->npending == 0 && !l->done)
+                pthread_cond_wait(&l->more, &l->lock);
+
+        /* Swap the buffers: ours is used up. */
+        p = l->taken;
+        cap = l->taken_cap;
+        l->taken = l->pending;
+        l->taken_cap = l->pending_cap;
+        l->ntaken = l->npending;
+        l->pending = p;
+        l->pending_cap = cap;
+        l->npending = 0;
+        l->next = 0;
+        more = l->ntaken > 0 || !l->done;
+        pthread_mutex_unlock(&l->lock);
+
+        return more;
+}
+
+static int
+loader_add_rows(struct loader *l, int max, int wait) {
+        int added = 0;
+
+        while (added < max) {
+                erow *row;
+                size_t end;
+
+                if (l->next == l->ntaken) {
+                        if (!loader_take(l, wait))
+                                return 0;
+                        if (l->ntaken == 0)
+                                break;
+                }
+
+                end = l->taken[l->next++];
+                row = line_index_append(&E->lines);
+                row->chars = (char *) l->text + l->start;
+                row->size = end - l->start;
+                if (row->size > 0 && (l->text[end - 1] == '\n' || l->text[end - 1] == '\r'))
+                        row->size--;
+                l->start = end;
+                if (l->fd != -1)
+                        E->text.orig_len = end; /* Rows are views into what is read (see piece_is_orig()). */
+                E->numrows++;
+                added++;
+        }
+
+        return 1;
+}
+
+/**
+ * Adds at most max rows from the line ends found so far to E.
+ * return 0 when the whole file is in.
+ */
+int
+loader_drain(struct loader *l, int max) {
+        return loader_add_rows(l, max, 0);
+}
+
+/**
+ * Adds rows until E has numrows of them, waiting for the thread.
+ * return 0 if the whole file is in with fewer.
+ */
+int
+loader_wait(struct loader *l, int numrows) {
+        while (E->numrows < numrows)
+                if (!loader_add_rows(l, numrows - E->numrows, 1))
+                        return 0;
+
+        return 1;
+}
+
+/* Are there rows to add, or is the load over? A stream may be waiting for more. */
+int
+loader_ready(struct loader *l) {
+        int ready;
+
+        pthread_mutex_lock(&l->lock);
+        ready = l->next < l->ntaken || l->npending > 0 || l->done;
+        pthread_mutex_unlock(&l->lock);
+
+        return ready;
+}
+
+/* How much of the text is in rows. */
+int
+loader_percent(struct loader *l) {
+        return l->len > 0 ? (int) (100.0 * l->start / l->len) : 100;
+}
+
+/* Stops the thread (if still going) and frees l. */
+void
+loader_free(struct loader *l) {
+        pthread_mutex_lock(&l->lock);
+        l->cancel = 1;
+        pthread_mutex_unlock(&l->lock);
+        pthread_join(l->thread, NULL);
+        if (l->fd != -1)
+                close(l->fd);
+
+        pthread_mutex_destroy(&l->lock);
+        pthread_cond_destroy(&l->more);
+        free(l->pending);
+        free(l->taken);
+        free(l);
+}
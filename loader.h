@@ -0,0 +1,61 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+/**
+        loader.h
+
+        Loading a big file in the background. A thread finds the line
+        ends of the (mapped) text and publishes them in batches; the main
+        thread turns them into rows between key presses, a bounded number
+        at a time, so the first screen is shown at once and the part
+        loaded can be scrolled and searched while the rest is scanned.
+
+        A stream (piped input) is loaded the same way: the thread reads it
+        into text as it comes, and the rows of each line appear as soon as
+        its '\n' has been read.
+*/
+
+/* Rows made per loader_drain() call, so that keys are not kept waiting. */
+#define LOADER_DRAIN_ROWS (64 * 1024)
+
+/* Read from a stream at a time; how long the thread waits for it before looking at cancel. */
+#define LOADER_READ_SIZE (1024 * 1024)
+#define LOADER_READ_WAIT_MS 100
+
+struct loader {
+        pthread_t thread;
+        pthread_mutex_t lock;
+        pthread_cond_t more;    /* Signalled when ends are published. */
+        const char *text;
+        size_t len;             /* Of a stream: the room in text; the thread's. */
+        int fd;                 /* The stream, -1 if text is all there. */
+
+        /* Shared, under lock. */
+        size_t *pending;        /* Line ends (the offset after) not taken yet. */
+        size_t npending;
+        size_t pending_cap;
+        int done;               /* All the line ends have been published. */
+        int cancel;
+        int full;               /* A stream did not fit in text: the rest was not read. */
+        int err;                /* Reading a stream failed with this errno. */
+
+        /* The main thread's. */
+        size_t *taken;
+        size_t ntaken;
+        size_t taken_cap;
+        size_t next;            /* Index in taken. */
+        size_t start;           /* Offset of the next row. */
+};
+
+struct loader *loader_start(const char *text, size_t len);
+struct loader *loader_stream(int fd, char *text, size_t cap);
+int loader_ready(struct loader *l);
+int loader_drain(struct loader *l, int max);
+int loader_wait(struct loader *l, int numrows);
+int loader_percent(struct loader *l);
+void loader_free(struct loader *l);
+
+#endif
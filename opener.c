@@ -0,0 +1,191 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "opener.h"
+#include "command.h"
+#include "gz.h"
+#include "row.h"
+#include "save.h"
+
+/**
+        opener.c
+
+        One queue for all the files of the command line; the threads are
+        detached and end when it is empty.
+*/
+
+static struct {
+        pthread_mutex_t lock;
+        pthread_cond_t done;    /* Broadcast when a job is done. */
+        struct open_job **jobs;
+        int n;
+        int next;               /* The first job perhaps still queued. */
+} opener = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, 0, 0 };
+
+struct open_job *
+open_job_new(const char *filename) {
+        struct open_job *j = calloc(1, sizeof(struct open_job));
+
+        if (j == NULL || (j->filename = strdup(filename)) == NULL)
+                die("open_job");
+
+        piece_table_init(&j->text);
+        line_index_init(&j->lines);
+        return j;
+}
+
+/**
+ * Reads the file of j: finishes a save of it cut short, maps (or
+ * inflates) it and, unless it is so big as to be viewed or loaded in the
+ * background, splits it into rows. Touches nothing but j.
+ */
+void
+open_job_read(struct open_job *j) {
+        int fd;
+
+        clock_gettime(CLOCK_MONOTONIC, &j->start);
+        j->absolute_filename = realpath(j->filename, NULL);
+
+        /* A save cut short (see save.h) is finished before reading the file. */
+        if (j->absolute_filename != NULL && save_recover(j->absolute_filename) == 1)
+                j->recovered = 1;
+
+        if (stat(j->filename, &j->st) == -1) {
+                if (errno == ENOENT)
+                        j->is_new = 1;
+                else
+                        j->failed = "stat";
+                j->err = errno;
+                return;
+        }
+
+        fd = open(j->absolute_filename, O_RDONLY);
+        if (fd == -1) {
+                j->failed = "open";
+                j->err = errno;
+                return;
+        }
+
+        /* The file is mapped (or inflated); rows are views into it until edited. */
+        j->gzip = gz_is_gzip(fd);
+        if (j->gzip && piece_table_inflate(&j->text, fd) == -1) {
+                j->bad_gzip = 1;
+                j->gzip = 0;
+        }
+        if (!j->gzip && piece_table_map(&j->text, fd, j->st.st_size) == -1) {
+                j->failed = "read";
+                j->err = errno;
+        }
+        close(fd);
+
+        /* The sizes are of the text: a gzip file is bigger inflated. */
+        if (j->failed == NULL && !open_readonly && j->text.orig_len > 0
+                && j->text.orig_len < KILO_VIEWER_MIN_SIZE
+                && j->text.orig_len < KILO_ASYNC_LOAD_MIN_SIZE) {
+                j->numrows = editor_rows_split(&j->lines, j->text.orig, j->text.orig_len);
+                j->rows_made = 1;
+        }
+        j->load_time = elapsed_since(&j->start);
+}
+
+/* Frees j (after opener_wait() if queued); its text and rows have been taken over by a buffer. */
+void
+open_job_free(struct open_job *j) {
+        free(j->filename);
+        free(j);
+}
+
+/* Takes the next job still queued. return NULL if none */
+static struct open_job *
+opener_next() {
+        struct open_job *j = NULL;
+
+        pthread_mutex_lock(&opener.lock);
+        while (opener.next < opener.n && j == NULL) {
+                j = opener.jobs[opener.next++];
+                if (j == NULL || j->state != OPEN_JOB_QUEUED)
+                        j = NULL; /* Taken by opener_wait(). */
+                else
+                        j->state = OPEN_JOB_READING;
+        }
+        pthread_mutex_unlock(&opener.lock);
+
+        return j;
+}
+
+static void
+opener_done(struct open_job *j) {
+        pthread_mutex_lock(&opener.lock);
+        j->state = OPEN_JOB_DONE;
+        pthread_cond_broadcast(&opener.done);
+        pthread_mutex_unlock(&opener.lock);
+}
+
+static void *
+opener_run(void *arg) {
+        struct open_job *j;
+
+        (void) arg;
+        while ((j = opener_next()) != NULL) {
+                open_job_read(j);
+                opener_done(j);
+        }
+
+        return NULL;
+}
+
+/* Starts reading the files of jobs[0..n[ (kept by the caller) in order. */
+void
+opener_start(struct open_job **jobs, int n) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        int nthreads = n;
+        int i;
+
+        if (nthreads > OPENER_MAX_THREADS)
+                nthreads = OPENER_MAX_THREADS;
+        if (ncpu > 0 && nthreads > ncpu)
+                nthreads = ncpu;
+
+        pthread_mutex_lock(&opener.lock);
+        opener.jobs = jobs;
+        opener.n = n;
+        opener.next = 0;
+        pthread_mutex_unlock(&opener.lock);
+
+        for (i = 0; i < nthreads; i++) {
+                pthread_t thread;
+
+                if (pthread_create(&thread, NULL, opener_run, NULL) != 0)
+                        break; /* opener_wait() reads the files left. */
+                pthread_detach(thread);
+        }
+}
+
+/**
+ * Waits for j to be read; reads it here if no thread has started on it.
+ * j is then the caller's to free: the threads do not look at it again.
+ */
+void
+opener_wait(struct open_job *j) {
+        int i;
+
+        pthread_mutex_lock(&opener.lock);
+        if (j->state == OPEN_JOB_QUEUED) {
+                j->state = OPEN_JOB_READING;
+                pthread_mutex_unlock(&opener.lock);
+                open_job_read(j);
+                pthread_mutex_lock(&opener.lock);
+                j->state = OPEN_JOB_DONE;
+        }
+
+        while (j->state != OPEN_JOB_DONE)
+                pthread_cond_wait(&opener.done, &opener.lock);
+
+        for (i = opener.next; i < opener.n; i++)
+                if (opener.jobs[i] == j)
+                        opener.jobs[i] = NULL;
+        pthread_mutex_unlock(&opener.lock);
+}
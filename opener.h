@@ -0,0 +1,55 @@
+#ifndef OPENER_H
+#define OPENER_H
+
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "piece.h"
+#include "lines.h"
+
+/**
+        opener.h
+
+        Reading files into buffers. open_job_read() does the part of
+        opening a file that needs no editor state: the file is mapped
+        (or inflated) and split into rows. So the files given on the
+        command line are read on a pool of threads, while the main thread
+        links their buffers in order; a buffer is finished (the rest of
+        command_open_file()) when it is first shown, see editor_open_pending().
+*/
+
+/* Threads reading files; no more than the processors. */
+#define OPENER_MAX_THREADS 8
+
+enum open_job_state {
+        OPEN_JOB_QUEUED = 0,
+        OPEN_JOB_READING,
+        OPEN_JOB_DONE
+};
+
+struct open_job {
+        char *filename;                 /* As given. */
+        char *absolute_filename;        /* NULL if there is no such file. */
+        struct stat st;
+        const char *failed;             /* "stat", "open" or "read" if that failed (errno in err). */
+        int err;
+        int is_new;
+        int gzip;
+        int bad_gzip;                   /* Looked like gzip but was not: read as is. */
+        int recovered;                  /* save_recover() finished a save cut short. */
+        struct piece_table text;
+        struct line_index lines;        /* The rows, if rows_made. */
+        int numrows;
+        int rows_made;
+        struct timespec start;
+        double load_time;
+        int state;                      /* Under the opener's lock. */
+};
+
+struct open_job *open_job_new(const char *filename);
+void open_job_read(struct open_job *j);
+void open_job_free(struct open_job *j);
+void opener_start(struct open_job **jobs, int n);
+void opener_wait(struct open_job *j);
+
+#endif
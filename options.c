@@ -156,15 +156,11 @@ options_parse(int argc, char **argv, char *options, int *next) {
         int i = 1; 
         
         do {
-                /* No dealing with '-'. */
+                /* '-' is a file: the piped input. It ends option parsing. */
                 if (! strcmp(argv[i], "-")) {
-                        printf("Unknown option - (STDIN read not yet implemented).\r\n\r\n");
-                        display_help();
-                        exit(1);       
-                }
-                
-                /* '--' ends option parsing. */
-                if (! strcmp(argv[i], "--")) {
+                        parsed = 1; 
+                } else if (! strcmp(argv[i], "--")) {
+                        /* '--' ends option parsing. */
                         // No more options. Advance next. 
                         parsed = 1; 
                         i++;
@@ -175,11 +171,7 @@ options_parse(int argc, char **argv, char *options, int *next) {
                         // be recognized unless prepended by './'.
                                                 
                         if (strlen(argv[i]) >= 1 && argv[i][0] == '-') {
-                                /* We don't deal with a single '-', so no STDIN read yet 
-                                   (when forth is added then we can manipulate text like sed?)
-                                   
-                                   i = last processed index
-                                */
+                                /* i = last processed index */
                                 int rc = options_find(argc, argv, list, &i);
                                 
                                 if (rc == OPTION_UNKNOWN_OPTION) {
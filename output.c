@@ -1,14 +1,33 @@
 
 #include "output.h"
+#include "command.h"
+
+/* Makes room for len more bytes; -1 if there is not memory. */
+int
+ab_reserve(struct abuf *ab, int len) {
+	int cap = ab->cap ? ab->cap : ABUF_MIN_CAP; 
+	char *new; 
+
+	if (ab->len + len <= ab->cap)
+		return 0; 
+
+	while (cap < ab->len + len)
+		cap *= 2; 
+	new = realloc(ab->b, cap); 
+	if (new == NULL)
+		return -1; 
+
+	ab->b = new; 
+	ab->cap = cap; 
+	return 0; 
+}
 
 void
 ab_append(struct abuf *ab, const char *s, int len) {
-	char *new = realloc(ab->b, ab->len + len);	
-	if (new == NULL)
+	if (ab_reserve(ab, len) == -1)
 		return;
 
-	memcpy(&new[ab->len], s, len); /* ! */
-	ab->b = new;
+	memcpy(&ab->b[ab->len], s, len); /* ! */
 	ab->len += len; 
 }
 
@@ -22,7 +41,7 @@ editor_scroll() {
 	E->rx = 0; 
 
 	if (E->cy < E->numrows) 
-		E->rx = editor_row_cx_to_rx(&E->row[E->cy], E->cx);
+		E->rx = editor_row_cx_to_rx(editor_row_at(E->cy), E->cx);
 
 	if (E->cy < E->rowoff)
 		E->rowoff = E->cy;
@@ -38,7 +57,7 @@ editor_scroll() {
 }
 
 void
-editor_draw_rows(struct abuf *ab) {
+editor_draw_rows() {
 	int y;
 	int filerow; 
 
@@ -46,6 +65,7 @@ editor_draw_rows(struct abuf *ab) {
 		filerow = y + E->rowoff; 
 
 		if (filerow >= E->numrows) {
+			screen_put(y, 0, "~", 1, 0); 
 			if (!E->is_banner_shown && E->numrows == 0 && y == TERMINAL.screenrows / 3) {
 				int padding = 0;
 	      	        	char welcome[80];
@@ -55,172 +75,188 @@ editor_draw_rows(struct abuf *ab) {
       				      welcomelen = TERMINAL.screencols;
       		
 	      		        padding = (TERMINAL.screencols - welcomelen) / 2;
-                                if (padding) {
-                                        ab_append(ab, "~", 1);
-	        		        padding--;
-	      		        }
-
-	      		        while (padding--) 
-	         			ab_append(ab, " ", 1);
-
-	      		        ab_append(ab, welcome, welcomelen);
-	      	        } else { // / 3
-			     ab_append(ab, "~", 1);
-		        }
+	      		        screen_put(y, padding, welcome, welcomelen, 0);
+	      	        } 
 		} else {
+			erow *row = editor_row_rendered(filerow); 
 			char *c; 
-			unsigned char *hl; 
 			int j; 
-			int current_colour = -1; 
-			int len = E->row[filerow].rsize - E->coloff;
+			int k; /* The span of column E->coloff + j. */
+			int last_hl = -1; 
+			int attr = 0; 
+			int len = row->r->rsize - E->coloff;
 			if (len < 0)
 				len = 0; 
 
       		        if (len > TERMINAL.screencols) 
       			       len = TERMINAL.screencols;
 
-      		        c  = &E->row[filerow].render[E->coloff];      		
-      		        hl = &E->row[filerow].hl[E->coloff];
-
-      		        for (j = 0; j < len; j++) {
-      			        if (iscntrl(c[j])) {
-      			                char sym = (c[j] <= 26) ? '@' + c[j] : '?';
-                                        ab_append(ab, "\x1b[7m", 4);
-      				        ab_append(ab, &sym, 1);
-      				        ab_append(ab, "\x1b[m", 3);
-      				        if (current_colour != -1) {
-      					       char buf[16];
-      					       int clen = snprintf(buf, sizeof(buf), "\x1b[%dm", current_colour); 
-      					       ab_append(ab, buf, clen);
-                                        }
-
-      			        } else if (hl[j] == HL_NORMAL) {
-                                        if (current_colour != -1) {
-                                                ab_append(ab, "\x1b[39m", 5); /* Text colours 30-37 (0=blak, 1=ref,..., 7=white. 9=reset*/
-                                                current_colour = -1; 
-      				        }
-      				        ab_append(ab, &c[j], 1);
-      				
-      			        } else {
-      				        int colour = syntax_to_colour(hl[j]);
-                                        if (colour != current_colour) {
-                                                char buf[16];
-                                                int clen = snprintf(buf, sizeof(buf), "\x1b[%dm", colour);
-                                                ab_append(ab, buf, clen);
-                                                current_colour = colour; 
-                                        }
-
-                                        ab_append(ab, &c[j], 1);
-                                }
+      		        c  = &ROW_RENDER(row)[E->coloff];      		
+
+			/* A run at a time: the rest of a span, cut at the find match. */
+			k = editor_row_span_at(row, 0, E->coloff); 
+			for (j = 0; j < len; ) {
+				unsigned char hl; 
+				int end = len; 
+				int i; 
+
+				if (k + 1 < row->r->nspans && row->r->spans[k + 1].start <= E->coloff + j)
+					k++; 
+				hl = row->r->spans[k].hl; 
+				if (k + 1 < row->r->nspans && row->r->spans[k + 1].start - E->coloff < end)
+					end = row->r->spans[k + 1].start - E->coloff; 
+
+				if (filerow == E->match_row) {
+					int ms = E->match_start - E->coloff; 
+					int me = E->match_end - E->coloff; 
+
+					if (j >= ms && j < me) {
+						hl = HL_MATCH; 
+						if (me < end)
+							end = me; 
+					} else if (j < ms && ms < end) {
+						end = ms; 
+					}
+				}
+
+				if (hl != last_hl) {
+					attr = hl == HL_NORMAL ? 0 : CELL_FG(syntax_to_colour(hl)); 
+					last_hl = hl; 
+				}
+
+				if (!row->r->cntrl) {
+					screen_put(y, j, &c[j], end - j, attr); 
+					j = end; 
+				}
+
+				/* Control characters are shown reversed, as ^X without the ^. */
+				while (j < end) {
+					for (i = j; i < end && !iscntrl(c[i]); i++)
+						; 
+					screen_put(y, j, &c[j], i - j, attr); 
+					for (j = i; j < end && iscntrl(c[j]); j++) {
+						char sym = (c[j] <= 26) ? '@' + c[j] : '?';
+						screen_put(y, j, &sym, 1, CELL_REVERSE); 
+					}
+				}
                         }
-
-                        ab_append(ab, "\x1b[39m", 5); /* Final reset. */
                 }
-
-                ab_append(ab, "\x1b[K", 3); /* K = erase line */
-                ab_append(ab, "\r\n", 2);
         }
 }
 
-
-#define ESC_PREFIX "\x1b["
-#define ESC_PREFIX_LEN 2
-#define APPEND_ESC_PREFIX(ab) (ab_append(ab, ESC_PREFIX, ESC_PREFIX_LEN))
-
-enum esc_codes {
-	ESC_BOLD = 1, 
-	ESC_DIM = 2, 
-	ESC_UNDERLINED = 4,
-	ESC_BLINK = 5, 
-	ESC_REVERSE = 7,
-	ESC_HIDDEN = 8, 
-	ESC_RESET_ALL = 0,
-	ESC_RESET_BOLD = 21,
-	ESC_RESET_DIM = 22,
-	ESC_RESET_UNDERLINED = 24,
-	ESC_RESET_BLINK = 25,
-	ESC_RESET_REVERSE = 27,
-	ESC_RESET_HIDDEN = 28
-};
-
-void
-esc_invert(struct abuf *ab) {
-	APPEND_ESC_PREFIX(ab);
-	ab_append(ab, "7m", 2);
-}
-
-void
-esc_bold(struct abuf *ab) {
-	APPEND_ESC_PREFIX(ab);
-	ab_append(ab, "1m", 2);
-}
-
-void
-esc_reset_all(struct abuf *ab) {
-	APPEND_ESC_PREFIX(ab);
-	ab_append(ab, "0m", 2);
-}
-
 void
-editor_draw_status_bar(struct abuf *ab) {
+editor_draw_status_bar() {
+	int y = TERMINAL.screenrows; 
 	int len = 0;
 	int rlen = 0;
 	char status[80], rstatus[80];
+	char loading[32] = ""; 
+
+	if (E->loader != NULL && E->loader->fd != -1)
+		snprintf(loading, sizeof(loading), "reading %zuM", E->loader->start >> 20); 
+	else if (E->loader != NULL)
+		snprintf(loading, sizeof(loading), "loading %d%%", loader_percent(E->loader)); 
+	else if (E->save != NULL)
+		snprintf(loading, sizeof(loading), "saving %d%%", save_percent(E->save)); 
 
-	//ab_append(ab, "\x1b[7m", 4); 
-	esc_invert(ab);
 	//len = snprintf(status, sizeof(status), "-- %.48s %s - %d lines %s", 
-	len = snprintf(status, sizeof(status), "-- %.48s %s %s", 
+	len = snprintf(status, sizeof(status), "-- %.48s %s %s %s", 
 		E->basename ? E->basename : "[No name]", 
                 E->is_new_file ? "(New file)" : "",
                 // E->numrows, 
-		E->dirty ? "(modified)" : ""); 
+		E->dirty ? "(modified)" : "", loading); 
 	rlen = snprintf(rstatus, sizeof(rstatus), "%s | %d/%d", 
 		E->syntax != NULL ? E->syntax->filetype : "no ft", E->cy + 1, E->numrows);
 
 	if (len > TERMINAL.screencols)
 		len = TERMINAL.screencols; 
 
-	ab_append(ab, status, len); 
-
-	while (len < TERMINAL.screencols) {
-		if (TERMINAL.screencols - len == rlen) {
-			ab_append(ab, rstatus, rlen);
-			break; 
-		} else {
-			ab_append(ab, " ", 1);
-			len++;
-		}
-	}
-
-	esc_reset_all(ab);
-	//ab_append(ab, "\x1b[m", 3); 
-	ab_append(ab, "\r\n", 2); 
+	/* Reversed all the way, the right part at the right edge if it fits. */
+	screen_fill(y, 0, ' ', TERMINAL.screencols, CELL_REVERSE); 
+	screen_put(y, 0, status, len, CELL_REVERSE); 
+	if (TERMINAL.screencols - len >= rlen)
+		screen_put(y, TERMINAL.screencols - rlen, rstatus, rlen, CELL_REVERSE); 
 }
 
-
 void 
 debug_cursor() {
 	char cursor[80];
 	snprintf(cursor, sizeof(cursor), "cx=%d rx=%d cy=%d len=%d coloff=%d screencols=%d", 
-		E->cx, E->rx, E->cy, E->row[E->cy].size, E->coloff, TERMINAL.screencols);
+		E->cx, E->rx, E->cy, E->cy < E->numrows ? editor_row_at(E->cy)->size : 0, 
+		E->coloff, TERMINAL.screencols);
 	editor_set_status_message(cursor); 
 }
 
 void
-editor_draw_message_bar(struct abuf *ab) {
+debug_memory() {
+	struct arena *a = &E->text.add; 
+	/* Memory for the rows, not counting the file itself. */
+	size_t bytes = a->bytes + E->lines.nblocks * (sizeof(struct line_block) + LINE_BLOCK_SIZE * sizeof(erow)); 
+
+	if (E->view.active)
+		bytes += VIEW_PAGES * VIEW_PAGE_LINES * sizeof(erow) + E->view.ncheckpoints * sizeof(size_t); 
+
+	editor_set_status_message("rows=%d erow=%zuB bytes/row=%.1f allocs=%ld frees=%ld mallocs=%ld arena=%zuK",
+		E->numrows, sizeof(erow), E->numrows ? (double) bytes / E->numrows : 0.0, 
+		a->allocs, a->frees, a->mallocs + E->lines.nblocks, a->bytes / 1024);
+}
+
+/* --debug 16: how fast the file was opened. */
+void
+debug_load() {
+	double mb = E->text.orig_len / (1024.0 * 1024.0); 
+
+	editor_set_status_message("loaded %d rows, %.1f MB in %.3f s (%.0f MB/s)%s",
+		E->numrows, mb, E->load_time, E->load_time > 0 ? mb / E->load_time : 0.0,
+		E->view.cached ? " from cache" : ""); 
+}
+
+/* --debug 32: what the edit journal costs. */
+void
+debug_journal() {
+	struct journal *j = E->journal; 
+	long commits; 
+
+	if (j == NULL) {
+		editor_set_status_message("no journal"); 
+		return; 
+	}
+
+	pthread_mutex_lock(&j->lock); 
+	commits = j->commits; 
+	pthread_mutex_unlock(&j->lock); 
+	editor_set_status_message("journal: %ld records, %.0f ns/record, %ld commits, %lld bytes",
+		j->records, j->records ? j->ns / j->records : 0.0, commits, (long long) j->length); 
+}
+
+/* --debug 64: what drawing the screen costs. */
+void
+debug_output() {
+	editor_set_status_message("output: %zu bytes last frame, %ld frames, %.0f bytes/frame",
+		SCREEN.last_bytes, SCREEN.frames, SCREEN.frames ? (double) SCREEN.bytes / SCREEN.frames : 0.0); 
+}
+
+void
+editor_draw_message_bar() {
 	int msglen; 
-	ab_append(ab, "\x1b[K", 3); 
 
         if (E->debug & DEBUG_CURSOR) {
         	debug_cursor();
+        } else if (E->debug & DEBUG_MEMORY) {
+        	debug_memory(); 
+        } else if (E->debug & DEBUG_LOAD) {
+        	debug_load(); 
+        } else if (E->debug & DEBUG_JOURNAL) {
+        	debug_journal(); 
+        } else if (E->debug & DEBUG_OUTPUT) {
+        	debug_output(); 
         }
 
 	msglen = strlen(E->statusmsg); 
 	if (msglen > TERMINAL.screencols)
 		msglen = TERMINAL.screencols; 
 	if (msglen && time(NULL) - E->statusmsg_time < 5) 
-		ab_append(ab, E->statusmsg, msglen);
+		screen_put(TERMINAL.screenrows + 1, 0, E->statusmsg, msglen, 0);
 
 }
 
@@ -248,25 +284,24 @@ editor_draw_message_bar(struct abuf *ab) {
 
 void 
 editor_refresh_screen() {
-	char buf[32];
-	struct abuf ab = ABUF_INIT;
+	static struct editor_config *last_E = NULL; 
+	static int last_rowoff; 
 
+	editor_open_pending(); 
+	editor_load_more(LOADER_DRAIN_ROWS); 
+	editor_save_reap(0); 
 	editor_scroll();
 
-  	ab_append(&ab, "\x1b[?25l", 6); /* cursor off (l = reset mode) */ 
-	ab_append(&ab, "\x1b[H", 3);
-
-	editor_draw_rows(&ab);
-	editor_draw_status_bar(&ab);
-	editor_draw_message_bar(&ab);
-
-  	snprintf(buf, sizeof(buf), "\x1b[%d;%dH", 
-  		(E->cy - E->rowoff) + 1, (E->rx + E->coloff) + 1);
-  	ab_append(&ab, buf, strlen(buf));
- 	ab_append(&ab, "\x1b[?25h", 6); /* cursor on (h = set mode) */
-
-	write(STDOUT_FILENO, ab.b, ab.len);
-	ab_free(&ab);
+	/* Drawn into the back grid, and only what changed is written. */
+	screen_begin(TERMINAL.screenrows + 2, TERMINAL.screencols); 
+	if (E == last_E && E->rowoff != last_rowoff) 
+		screen_scroll(0, TERMINAL.screenrows, E->rowoff - last_rowoff); /* The text rows only. */
+	last_E = E; 
+	last_rowoff = E->rowoff; 
+	editor_draw_rows();
+	editor_draw_status_bar();
+	editor_draw_message_bar();
+	screen_flush(E->cy - E->rowoff, E->rx + E->coloff); 
 }
 
 void
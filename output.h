@@ -11,26 +11,33 @@
 #include "row.h"
 #include "terminal.h"
 #include "highlight.h"
+#include "screen.h"
 
 struct abuf {
 	char *b;
 	int len; 
+	int cap;	/* Grows by doubling; reset len to reuse. */
 };
 
-#define ABUF_INIT { NULL, 0 }
+#define ABUF_INIT { NULL, 0, 0 }
+#define ABUF_MIN_CAP 4096
 
+int ab_reserve(struct abuf *ab, int len);
 void ab_append(struct abuf *ab, const char *s, int len);
 void ab_free(struct abuf *ab);
 
 /* TODO editor -> output */
 void editor_scroll();
-void editor_draw_rows(struct abuf *ab);
+void editor_draw_rows();
 void editor_refresh_screen();
 void editor_set_status_message(const char *fmt, ...);
-void editor_draw_message_bar(struct abuf *ab);
-void editor_draw_status_bar(struct abuf *ab);
-void editor_draw_rows(struct abuf *ab);
+void editor_draw_message_bar();
+void editor_draw_status_bar();
 void debug_cursor(); /* TODO maybe in debug.[ch] */
+void debug_memory();
+void debug_load();
+void debug_journal();
+void debug_output();
 
 #endif
 
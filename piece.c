@@ -0,0 +1,217 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "piece.h"
+#include "gz.h"
+#include "uring.h"
+
+/**
+        piece.c
+
+        The original text is mapped from the file (MAP_PRIVATE) or, if
+        that is not possible, loaded with one read() into a single block.
+        A gzip file is inflated into an anonymous mapping instead.
+        A row that is edited gets its bytes (plus some slack) copied to
+        the add buffer once; after that the row is edited in place until
+        the slack runs out. The add buffer is the buffer's arena, so the
+        copy a row outgrows is recycled for the next one of its size.
+*/
+
+void
+piece_table_init(struct piece_table *pt) {
+        pt->orig = NULL;
+        pt->orig_len = 0;
+        pt->mapped = 0;
+        pt->inflated = 0;
+        pt->reserved = 0;
+        pt->dev = 0;
+        pt->ino = 0;
+        pt->mode = 0;
+        pt->size = 0;
+        pt->mtime.tv_sec = 0;
+        pt->mtime.tv_nsec = 0;
+        arena_init(&pt->add);
+}
+
+void
+piece_table_free(struct piece_table *pt) {
+        arena_destroy(&pt->add);
+        if (pt->reserved > 0)
+                munmap(pt->orig, pt->reserved);
+        else if (pt->mapped || pt->inflated)
+                munmap(pt->orig, pt->orig_len);
+        else
+                free(pt->orig);
+        piece_table_init(pt);
+}
+
+/**
+ * Reads (at most) len bytes from fd as the original text.
+ *
+ * return 0 ok, -1 error (errno set)
+ */
+int
+piece_table_load(struct piece_table *pt, int fd, size_t len) {
+        struct uring ring;
+        struct stat st;
+        size_t total = 0;
+        ssize_t n;
+
+        free(pt->orig);
+        pt->orig = malloc(len + 1);
+        if (pt->orig == NULL)
+                return -1;
+
+        /* --io uring: several reads in flight (a file has offsets, a pipe does not). */
+        if (len > 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && uring_open(&ring) == 0) {
+                n = uring_read(&ring, fd, pt->orig, len, lseek(fd, 0, SEEK_CUR));
+                uring_free(&ring);
+                if (n == -1)
+                        return -1;
+                pt->orig_len = n;
+                return 0;
+        }
+
+        while (total < len) {
+                n = read(fd, pt->orig + total, len - total);
+                if (n == -1) {
+                        if (errno == EINTR)
+                                continue;
+                        return -1;
+                }
+                if (n == 0)
+                        break; /* The file shrank under us. */
+                total += n;
+        }
+
+        pt->orig_len = total;
+        return 0;
+}
+
+/**
+ * Maps len bytes of fd as the original text. Only the pages touched 
+ * take memory, and that is page cache. Falls back to piece_table_load() 
+ * for empty files and files that cannot be mapped.
+ *
+ * return 0 ok, -1 error (errno set)
+ */
+int
+piece_table_map(struct piece_table *pt, int fd, size_t len) {
+        struct stat st;
+        void *p;
+
+        if (len == 0 || fstat(fd, &st) == -1 || !S_ISREG(st.st_mode))
+                return piece_table_load(pt, fd, len);
+
+        p = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED)
+                return piece_table_load(pt, fd, len);
+
+        free(pt->orig);
+        pt->orig = p;
+        pt->orig_len = len;
+        pt->mapped = 1;
+        pt->dev = st.st_dev;
+        pt->ino = st.st_ino;
+        pt->mode = st.st_mode;
+        pt->size = st.st_size;
+        pt->mtime = st.st_mtim;
+        return 0;
+}
+
+/**
+ * Inflates the gzip file fd as the original text (see gz.h).
+ *
+ * return 0 ok, -1 error (errno set)
+ */
+int
+piece_table_inflate(struct piece_table *pt, int fd) {
+        char *text;
+        size_t len;
+
+        if (gz_inflate(fd, &text, &len) == -1)
+                return -1;
+
+        free(pt->orig);
+        pt->orig = text;
+        pt->orig_len = len;
+        pt->inflated = text != NULL;
+        return 0;
+}
+
+/**
+ * Reserves (at most max bytes of) address space as the original text, to
+ * be filled as a stream is read (see loader_stream()). It does not move,
+ * so rows can be views into it; pages take memory only when written.
+ * orig_len is what is in rows so far.
+ *
+ * return 0 ok, -1 error (errno set)
+ */
+int
+piece_table_reserve(struct piece_table *pt, size_t max) {
+        void *p = MAP_FAILED;
+
+        /* Less if that much cannot be had (vm.overcommit_memory = 2). */
+        for (; max >= PIECE_RESERVE_MIN_SIZE; max /= 2) {
+                p = mmap(NULL, max, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+                if (p != MAP_FAILED)
+                        break;
+        }
+        if (p == MAP_FAILED)
+                return -1;
+
+        free(pt->orig);
+        pt->orig = p;
+        pt->orig_len = 0;
+        pt->reserved = max;
+        return 0;
+}
+
+/**
+ * Is filename the file orig is mapped from? Writing to it in place 
+ * would change (or, if it shrinks, unmap) the rows that still are views.
+ */
+int
+piece_maps_file(struct piece_table *pt, const char *filename) {
+        struct stat st;
+
+        if (!pt->mapped || stat(filename, &st) == -1)
+                return 0;
+
+        return st.st_dev == pt->dev && st.st_ino == pt->ino;
+}
+
+int
+piece_is_orig(struct piece_table *pt, const char *p) {
+        return pt->orig != NULL && p >= pt->orig && p <= pt->orig + pt->orig_len;
+}
+
+/**
+ * Copies len bytes of s into the add buffer reserving cap (>= len) bytes.
+ * Use arena_size(cap) as cap to get all of the space that is reserved.
+ *
+ * return pointer to the copy or NULL.
+ */
+char *
+piece_add(struct piece_table *pt, const char *s, size_t len, size_t cap) {
+        char *p;
+
+        if (cap < len)
+                cap = len;
+
+        p = arena_alloc(&pt->add, cap);
+        if (p != NULL && len > 0)
+                memcpy(p, s, len);
+
+        return p;
+}
+
+/* Gives back a copy made by piece_add(). */
+void
+piece_release(struct piece_table *pt, char *p, size_t cap) {
+        arena_free(&pt->add, p, cap);
+}
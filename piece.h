@@ -0,0 +1,46 @@
+#ifndef PIECE_H
+#define PIECE_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <time.h>
+#include "arena.h"
+
+/**
+        piece.h
+
+        Text storage of a buffer: the original file contents, which are
+        never written to, and an add buffer for everything typed or
+        inserted afterwards. Rows (erow) are views into either one of
+        them: opening a file does not copy any lines.
+*/
+
+/* The least piece_table_reserve() settles for. */
+#define PIECE_RESERVE_MIN_SIZE (64L * 1024 * 1024)
+
+struct piece_table {
+        char *orig;             /* The file as read from the disk. Read-only. */
+        size_t orig_len;
+        int mapped;             /* orig is mmap'd from the file below. */
+        int inflated;           /* orig is a gzip file inflated to an anonymous mapping. */
+        size_t reserved;        /* orig is an anonymous mapping of this size filled by a stream. */
+        dev_t dev;
+        ino_t ino;
+        mode_t mode;
+        off_t size;             /* The file on the disk as last loaded or saved in place. */
+        struct timespec mtime;
+        struct arena add;       /* The add buffer; also render & hl of rows. */
+};
+
+void piece_table_init(struct piece_table *pt);
+void piece_table_free(struct piece_table *pt);
+int piece_table_load(struct piece_table *pt, int fd, size_t len);
+int piece_table_map(struct piece_table *pt, int fd, size_t len);
+int piece_table_inflate(struct piece_table *pt, int fd);
+int piece_table_reserve(struct piece_table *pt, size_t max);
+int piece_maps_file(struct piece_table *pt, const char *filename);
+int piece_is_orig(struct piece_table *pt, const char *p);
+char *piece_add(struct piece_table *pt, const char *s, size_t len, size_t cap);
+void piece_release(struct piece_table *pt, char *p, size_t cap);
+
+#endif
@@ -4,6 +4,7 @@
 #include "row.h"
 #include "output.h"
 #include "token.h"
+#include "scan.h"
 
 extern struct editor_config *E; 
 
@@ -104,7 +105,7 @@ editor_row_cx_to_rx(erow *row, int cx) {
 	int j; 
 
 	for (j = 0; j < cx; j++) {
-		if (row->chars[j] == '\t') 
+		if (ROW_CHAR(row, j) == '\t') 
 			rx += (E->tab_stop - 1) - (rx % E->tab_stop);
 		rx++; 
 	}
@@ -117,7 +118,7 @@ editor_row_rx_to_cx(erow *row, int rx) {
 	int cx; 
 
 	for (cx = 0; cx < row->size; cx++) {
-		if (row->chars[cx] == '\t')
+		if (ROW_CHAR(row, cx) == '\t')
 			cur_rx = (E->tab_stop - 1) - (cur_rx % E->tab_stop);
 
 		cur_rx++; 
@@ -129,80 +130,471 @@ editor_row_rx_to_cx(erow *row, int rx) {
 	return cx; 
 }
 
+/**
+ * The row has changed: its render and hl are rebuilt when it is drawn 
+ * or searched next time (see editor_row_rendered()).
+ */
 void
 editor_update_row(erow *row) {
+	row->flags &= ROW_INLINE; 
+}
+
+/* Scratch space for editor_render_row(). */
+static char *render_buf; 
+static unsigned char *hl_buf; 
+static int render_buf_size; 
+
+/* Builds render and hl (as spans) of row. */
+static void
+editor_render_row(erow *row) {
 	int j; 
 	int idx = 0;
+	int rsize = 0; 
 	int tabs = 0; 
+	int nspans = 0; 
+	int shared; 
+	int open_comment = row->hl_open_comment; 
+	char *render; 
+	size_t size; 
+	struct row_render *r; 
+
+	for (j = 0; j < row->size; j++) { 
+		if (ROW_CHAR(row, j) == '\t') {
+			rsize += E->tab_stop - (rsize % E->tab_stop); 
+			tabs++; 
+		} else {
+			rsize++; 
+		}
+	}
 
-	for (j = 0; j < row->size; j++) { // There may always be tabs.
-		if (row->chars[j] == '\t') 
-			tabs++;
+	if (rsize + 1 > render_buf_size) {
+		render_buf_size = rsize + 1 > 2 * render_buf_size ? rsize + 1 : 2 * render_buf_size; 
+		render_buf = realloc(render_buf, render_buf_size); 
+		hl_buf = realloc(hl_buf, render_buf_size); 
+		if (render_buf == NULL || hl_buf == NULL)
+			die("editor_render_row"); 
 	}
 
-	free(row->render); 
-	row->render = malloc(row->size + tabs * (E->tab_stop - 1) + 1);
+	/* Without tabs and the gap out of the way the chars are the render. */
+	shared = tabs == 0 && (ROW_IS_INLINE(row) || row->capacity == 0 || row->gap_start >= row->size); 
+	if (shared) {
+		render = ROW_CHARS(row); 
+	} else {
+		render = render_buf; 
+		for (j = 0; j < row->size; j++) {
+			char c = ROW_CHAR(row, j); 
+			if (c == '\t') {
+				render[idx++] = ' ';
+				while (idx % E->tab_stop != 0) 
+					render[idx++] = ' ';
+			} else {
+				render[idx++] = c;
+			}
+		}
+	}
 
-	for (j = 0; j < row->size; j++) {
-		if (row->chars[j] == '\t') {
-			row->render[idx++] = ' ';
-			while (idx % E->tab_stop != 0) 
-				row->render[idx++] = ' ';
-		} else {
-			row->render[idx++] = row->chars[j];
+	syntax_update(row, render, rsize, hl_buf);
+
+	for (j = 0; j < rsize; j++) 
+		if (j == 0 || hl_buf[j] != hl_buf[j - 1])
+			nspans++; 
+
+	editor_free_render(row); 
+	size = sizeof(struct row_render) + nspans * sizeof(struct hl_span) + (shared ? 0 : rsize); 
+	r = arena_alloc(&E->text.add, size);
+	if (r == NULL)
+		die("editor_render_row");
+
+	r->rsize = rsize; 
+	r->nspans = 0; 
+	r->cntrl = 0; 
+	for (j = 0; j < rsize; j++) {
+		if (iscntrl(render[j]))
+			r->cntrl = 1; 
+		if (j == 0 || hl_buf[j] != hl_buf[j - 1]) {
+			r->spans[r->nspans].start = j; 
+			r->spans[r->nspans].hl = hl_buf[j]; 
+			r->nspans++; 
 		}
 	}
 
-	row->render[idx] = '\0';
-	row->rsize = idx; 
+	r->render = NULL; 
+	if (!shared) {
+		r->render = (char *) &r->spans[nspans]; 
+		memcpy(r->render, render, rsize); 
+	}
+
+	row->r = r; 
+	row->flags = (row->flags & ROW_INLINE) | ROW_RENDERED | ROW_HL_STATE; 
+	row->gen = E->render_gen; 
+
+	/* The next row starts in a different state; it has to be redone. */
+	if (row->hl_open_comment != open_comment) {
+		erow *next = editor_row_at(editor_row_index(row) + 1); 
+		if (next != NULL)
+			editor_update_row(next); 
+	}
+}
+
+/* The bytes the render of row takes in the arena. */
+static size_t
+editor_render_size(erow *row) {
+	return sizeof(struct row_render) + row->r->nspans * sizeof(struct hl_span) 
+		+ (row->r->render != NULL ? row->r->rsize : 0); 
+}
+
+/**
+ * The row at 'at' with render and hl up to date, or NULL.
+ *
+ * With multiline comments a row depends on the rows above it, so rows
+ * whose state is not known are highlighted first. Only their state is 
+ * kept; render and hl of the rows not drawn are not. In a read-only 
+ * view this goes back to the start of the page at most.
+ */
+erow *
+editor_row_rendered(int at) {
+	erow *row = editor_row_at(at); 
+	int from = at; 
+	int first = E->view.active ? at - at % VIEW_PAGE_LINES : 0; 
+
+	if (row == NULL)
+		return NULL; 
+
+	if (syntax_is_multiline()) {
+		while (from > first && !ROW_IS(editor_row_at(from - 1), ROW_HL_STATE))
+			from--; 
+
+		for (; from < at; from++) {
+			erow *r = editor_row_at(from); 
+			editor_render_row(r); 
+			editor_row_drop_render(r); 
+		}
+	}
+
+	if (!ROW_IS(row, ROW_RENDERED))
+		editor_render_row(row); 
+
+	return row; 
+}
+
+/* Frees render and hl of a row that is not drawn; its state is kept. */
+void
+editor_row_drop_render(erow *row) {
+	int state = ROW_IS(row, ROW_HL_STATE); 
+
+	editor_free_render(row); 
+	row->flags &= ROW_INLINE; 
+	if (state)
+		row->flags |= ROW_HL_STATE; 
+}
+
+/**
+ * The index of the span of a rendered row covering column rx. 
+ * The search starts from span k; draw left to right to keep it short.
+ */
+int
+editor_row_span_at(erow *row, int k, int rx) {
+	while (k + 1 < row->r->nspans && row->r->spans[k + 1].start <= rx)
+		k++; 
+	return k; 
+}
+
+/**
+ * Makes the chars of row writable with room for at least len chars and 
+ * '\0'. A view into the original text is copied only now: into the row
+ * itself if short enough, to the add buffer otherwise. 
+ */
+void
+editor_row_reserve(erow *row, int len) {
+	int cap; 
+	char *p; 
+
+	if (ROW_IS_INLINE(row)) {
+		if (len < ROW_INLINE_SIZE)
+			return; 
+		cap = ROW_INLINE_SIZE * 2; 
+	} else if (row->capacity > len) {
+		return; 
+	} else if (row->capacity == 0 && len < ROW_INLINE_SIZE) {
+		memcpy(row->inl, row->chars, row->size); /* row->chars is read first. */
+		row->inl[row->size] = '\0';
+		row->flags |= ROW_INLINE; 
+		return; 
+	} else {
+		editor_row_close_gap(row); 
+		cap = row->capacity * 2; 
+	}
+
+	if (cap < len + 1)
+		cap = len + 1; 
+	if (cap < ROW_MIN_CAPACITY)
+		cap = ROW_MIN_CAPACITY; 
+
+	cap = arena_size(cap); 
+	p = piece_add(&E->text, ROW_CHARS(row), row->size, cap); 
+	if (p == NULL)
+		die("editor_row_reserve");
+
+	if (!ROW_IS_INLINE(row) && row->capacity > 0)
+		piece_release(&E->text, row->chars, row->capacity); 
+
+	/* All the slack is the gap, at the end. */
+	p[row->size] = '\0';
+	p[cap - 1] = '\0';
+	row->flags &= ~ROW_INLINE; 
+	row->chars = p; 
+	row->capacity = cap; 
+	row->gap_start = row->size; 
+}
+
+/* Moves the gap of a writable row in the add buffer to 'at'. */
+static void
+editor_row_move_gap(erow *row, int at) {
+	int gap_len = ROW_GAP_LEN(row); 
 
-	syntax_update(row);
+	if (at < row->gap_start) 
+		memmove(&row->chars[at + gap_len], &row->chars[at], row->gap_start - at); 
+	else if (at > row->gap_start)
+		memmove(&row->chars[row->gap_start], &row->chars[row->gap_start + gap_len], 
+			at - row->gap_start); 
+
+	row->gap_start = at; 
+}
+
+/* Makes the chars of row contiguous (and '\0' terminated if writable). */
+void
+editor_row_close_gap(erow *row) {
+	if (ROW_IS_INLINE(row) || row->capacity == 0)
+		return; 
+
+	editor_row_move_gap(row, row->size); 
+	row->chars[row->size] = '\0';
+}
+
+/* Row 'at' changes: an incremental save writes from there on (see save.h). */
+static void
+editor_row_changed(int at) {
+	E->changes++; 
+	if (at < E->dirty_from)
+		E->dirty_from = at; 
+}
+
+/* Inserts len bytes of s at 'at'. Repeated inserts at the gap are O(1). */
+static void
+editor_row_insert_bytes(erow *row, int at, const char *s, int len) {
+	int r = editor_row_index(row); 
+
+	editor_row_changed(r); 
+	journal_record(JOURNAL_INSERT_BYTES, r, at, s, len); 
+	editor_row_reserve(row, row->size + len); 
+
+	if (ROW_IS_INLINE(row)) {
+		memmove(&row->inl[at + len], &row->inl[at], row->size - at + 1); 
+		memcpy(&row->inl[at], s, len); 
+		row->size += len; 
+		return; 
+	}
+
+	editor_row_move_gap(row, at); 
+	memcpy(&row->chars[at], s, len); 
+	row->gap_start += len; 
+	row->size += len; 
+}
+
+/* Deletes len bytes at 'at' by widening the gap. */
+static void
+editor_row_delete_bytes(erow *row, int at, int len) {
+	int r = editor_row_index(row); 
+
+	editor_row_changed(r); 
+	journal_record(JOURNAL_DELETE_BYTES, r, at, NULL, len); 
+	editor_row_reserve(row, row->size); 
+
+	if (ROW_IS_INLINE(row)) {
+		memmove(&row->inl[at], &row->inl[at + len], row->size - at - len + 1); 
+		row->size -= len; 
+		return; 
+	}
+
+	editor_row_move_gap(row, at + len); 
+	row->gap_start = at; 
+	row->size -= len; 
+}
+
+/* The row at line 'at' or NULL if there is no such row. */
+erow *
+editor_row_at(int at) {
+	if (E->view.active)
+		return view_row_at(&E->view, at); 
+	return line_index_get(&E->lines, at); 
+}
+
+/* The line number of row. */
+int
+editor_row_index(erow *row) {
+	if (E->view.active)
+		return view_row_number(&E->view, row); 
+	return line_index_row_number(&E->lines, row); 
+}
+
+/* The row (if any) at 'at' has to be highlighted again. */
+static void
+editor_invalidate_row(int at) {
+	erow *row = editor_row_at(at); 
+	if (row != NULL)
+		editor_update_row(row); 
+}
+
+/* A new, empty row at 'at'; the rows after it move. */
+static erow *
+editor_insert_row_slot(int at, size_t len) {
+	erow *row = line_index_insert(&E->lines, at); 
+
+	editor_row_changed(at); 
+	row->size = len;
+	editor_invalidate_row(at + 1); 
+	E->numrows++;
+	E->dirty++; 
+
+	return row; 
 }
 
 void
 editor_insert_row(int at, char *s, size_t len) {
-	int j; 
-	if (at < 0 || at > E->numrows > 0)
+	char buf[ROW_INLINE_SIZE]; 
+	char *p = NULL; 
+	int cap = 0; 
+	erow *row; 
+
+	if (at < 0 || at > E->numrows)
 		return; 
 
-	E->row = realloc(E->row, sizeof(erow) * (E->numrows + 1));
-	memmove(&E->row[at + 1], &E->row[at], sizeof(erow) * (E->numrows - at));
-	for (j = at + 1; j <= E->numrows; j++)
-		E->row[j].idx++; 
+	journal_record(JOURNAL_INSERT_ROW, at, 0, s, len); 
+
+	/* Copy first: s may be in a row that the insert moves. */
+	if (len < ROW_INLINE_SIZE) {
+		memcpy(buf, s, len); 
+	} else {
+		cap = arena_size(len + 1); 
+		p = piece_add(&E->text, s, len, cap);
+		if (p == NULL)
+			die("editor_insert_row");
+		p[len] = '\0';
+		p[cap - 1] = '\0';
+	}
 
-	E->row[at].idx = at; 
-  	E->row[at].size = len;
-  	E->row[at].chars = malloc(len + 1);
-  	memcpy(E->row[at].chars, s, len);
-  	E->row[at].chars[len] = '\0';
-  	E->row[at].rsize = 0;
-  	E->row[at].render = NULL; 
-  	E->row[at].hl = NULL;
-  	E->row[at].hl_open_comment = 0; 
+	row = editor_insert_row_slot(at, len); 
+	if (p == NULL) {
+		memcpy(row->inl, buf, len); 
+		row->inl[len] = '\0';
+		row->flags = ROW_INLINE; 
+	} else {
+		row->chars = p; 
+		row->capacity = cap; 
+		row->gap_start = len; 
+	}
+}
+
+/**
+ * Like editor_insert_row() but the row refers to s instead of a copy. 
+ * s must live as long as the buffer, ie. be in E->text.
+ */
+void
+editor_insert_row_ref(int at, char *s, size_t len) {
+	erow *row; 
+	if (at < 0 || at > E->numrows)
+		return; 
 
-  	editor_update_row(&E->row[at]); 
-  	
-  	E->numrows++;
-  	E->dirty++; 
+	journal_record(JOURNAL_INSERT_ROW, at, 0, s, len); 
+	row = editor_insert_row_slot(at, len); 
+	row->chars = s; 
+}
+
+/* Line ends looked for at a time by editor_load_rows(). */
+#define ROW_SCAN_BATCH 1024
+
+/**
+ * Makes the rows of an empty buffer from text (len bytes in E->text) in 
+ * one go: the line ends are found in bulk and the line index is built 
+ * at once. As with getline(), a final '\n' (or '\r') is not in the row.
+ */
+void
+editor_load_rows(char *text, size_t len) {
+	if (len == 0 || E->numrows != 0)
+		return; 
+
+	E->numrows = editor_rows_split(&E->lines, text, len); 
+}
+
+/**
+ * The rows of text (len > 0 bytes) to the empty line index li. Touches
+ * nothing else, so that files can be split on other threads (see opener.h).
+ *
+ * return the number of rows
+ */
+int
+editor_rows_split(struct line_index *li, char *text, size_t len) {
+	size_t pos[ROW_SCAN_BATCH]; 
+	size_t off = 0; /* Scanned so far. */
+	size_t start = 0; /* Of the next row. */
+	size_t scanned; 
+	size_t found; 
+	size_t k; 
+	int n; 
+	int at = 0; 
+	erow *row = NULL; 
+
+	n = scan_count_lines(text, len) + (text[len - 1] != '\n'); 
+	line_index_load(li, n); 
+
+	while (start < len) {
+		found = scan_find_lines(text + off, len - off, pos, ROW_SCAN_BATCH, &scanned); 
+		if (found == 0) /* The last line has no '\n'. */
+			pos[found++] = len - off - 1; 
+
+		for (k = 0; k < found; k++) {
+			size_t end = off + pos[k] + 1; 
+
+			/* line_index_load() filled the blocks: rows are consecutive in one. */
+			row = at % LINE_BLOCK_SIZE == 0 ? line_index_get(li, at) : row + 1; 
+			at++; 
+
+			row->chars = text + start; 
+			row->size = end - start; 
+			if (text[end - 1] == '\n' || text[end - 1] == '\r')
+				row->size--; 
+			start = end; 
+		}
+		off += scanned; 
+	}
+
+	return n; 
+}
+
+void
+editor_free_render(erow *row) {
+	if (row->r != NULL)
+		arena_free(&E->text.add, row->r, editor_render_size(row)); 
+	row->r = NULL; 
 }
 
 void
 editor_free_row(erow *row) {
-	free(row->render);
-	free(row->chars);
-	free(row->hl);
+	editor_free_render(row); 
+	if (!ROW_IS_INLINE(row) && row->capacity > 0)
+		piece_release(&E->text, row->chars, row->capacity); 
 }
 
 void
 editor_del_row(int at) {
-	int j;
-	if (at < 0 || at > E->numrows)
+	if (at < 0 || at >= E->numrows)
 		return;
 
-	editor_free_row(&E->row[at]);
-	memmove(&E->row[at], &E->row[at + 1], sizeof(erow) * (E->numrows - at - 1));
-	for (j = at; j < E->numrows - 1; j++)
-		E->row[j].idx--;
+	editor_row_changed(at); 
+	journal_record(JOURNAL_DELETE_ROW, at, 0, NULL, 0); 
+	editor_free_row(editor_row_at(at));
+	line_index_delete(&E->lines, at); 
+	editor_invalidate_row(at); 
 
 	E->numrows--;
 	E->dirty++;
@@ -233,13 +625,8 @@ editor_row_insert_char(erow *row, int at, char c) {
 		insert_len = 1; 
 	}
 
-	row->chars = realloc(row->chars, row->size + insert_len + 1); /* plus 1 is \0 */ 
-	memmove(&row->chars[at + insert_len], &row->chars[at], row->size - at + 1); 
-
-	for (i = 0; i < insert_len; i++) {
-		row->size++;
-		row->chars[at++] = c;
-	} 
+	for (i = 0; i < insert_len; i++) 
+		editor_row_insert_bytes(row, at++, &c, 1); 
 
 	editor_update_row(row); 	
 	E->dirty++; 
@@ -248,10 +635,7 @@ editor_row_insert_char(erow *row, int at, char c) {
 
 void 
 editor_row_append_string(erow *row, char *s, size_t len) {
-	row->chars = realloc(row->chars, row->size + len + 1);
-	memcpy(&row->chars[row->size], s, len);
-	row->size += len; 
-	row->chars[row->size] = '\0';
+	editor_row_insert_bytes(row, row->size, s, len); 
 	editor_update_row(row);
 	E->dirty++; 
 }
@@ -273,8 +657,8 @@ editor_row_del_char(erow *row, int at) {
 			/* There has to be at least E.tab_stop spaces to the left of 'at'.
 				Note: start counting from TAB_STOP below & upwards. */
 			for (i = at + 1 - E->tab_stop; enough_spaces_to_the_left && i >= 0 && i < at; i++) {
-				if ((E->is_soft_indent && row->chars[i] != ' ')
-					|| (!E->is_soft_indent && row->chars[i] != '\t')) {
+				if ((E->is_soft_indent && ROW_CHAR(row, i) != ' ')
+					|| (!E->is_soft_indent && ROW_CHAR(row, i) != '\t')) {
 					enough_spaces_to_the_left = 0; 
 				}
 			}
@@ -285,15 +669,206 @@ editor_row_del_char(erow *row, int at) {
 			enough_spaces_to_the_left = 0; 
 	} 
 
-	memmove(&row->chars[at + 1 - len], &row->chars[at + 1], row->size - at + 1); 
-	row->size -= len;
+	editor_row_delete_bytes(row, at + 1 - len, len); 
 	editor_update_row(row);
 	E->dirty++; 
 
 	return len; 
 }
 
+/**
+ * Does an edit of the journal again (see journal.h).
+ * return 0 done, -1 it does not fit the rows
+ */
+int
+editor_row_redo(int op, int at_row, int at, const char *s, int len) {
+	erow *row = editor_row_at(at_row); 
+
+	switch (op) {
+	case JOURNAL_INSERT_BYTES:
+		if (row == NULL || at > row->size)
+			return -1; 
+		editor_row_insert_bytes(row, at, s, len); 
+		break; 
+	case JOURNAL_DELETE_BYTES:
+		if (row == NULL || len > row->size - at)
+			return -1; 
+		editor_row_delete_bytes(row, at, len); 
+		break; 
+	case JOURNAL_INSERT_ROW:
+		if (at_row > E->numrows)
+			return -1; 
+		editor_insert_row(at_row, (char *) s, len); 
+		return 0; 
+	case JOURNAL_DELETE_ROW:
+		if (row == NULL)
+			return -1; 
+		editor_del_row(at_row); 
+		return 0; 
+	case JOURNAL_INSERT_TEXT: {
+		int cx = E->cx; 
+		int cy = E->cy; 
+
+		if (at_row > E->numrows || at > (row != NULL ? row->size : 0))
+			return -1; 
+		E->cy = at_row; 
+		E->cx = at; 
+		editor_insert_text(s, len); 
+		E->cx = cx; 
+		E->cy = cy; 
+		return 0; 
+		}
+	default:
+		return -1; 
+	}
+
+	editor_update_row(row); 
+	E->dirty++; 
+	return 0; 
+}
+
 /*** editor operations ***/
+
+/* A copy of the chars of row from 'at' on, *len of them. */
+static char *
+editor_row_copy_tail(erow *row, int at, int *len) {
+	char *tail; 
+
+	*len = row->size - at; 
+	if (*len <= 0)
+		return NULL; 
+
+	editor_row_reserve(row, row->size); 
+	editor_row_close_gap(row); 
+	tail = malloc(*len); 
+	if (tail == NULL)
+		die("editor_row_copy_tail"); 
+	memcpy(tail, &ROW_CHARS(row)[at], *len); 
+	return tail; 
+}
+
+/**
+ * Makes the n lines of p (len bytes in E->text, '\n' between them) rows
+ * at 'at' in one go: the line index makes room for all of them at once
+ * and they are views of p, as the rows of a file are of its text.
+ */
+static void
+editor_insert_rows(int at, char *p, size_t len, int n) {
+	size_t start = 0; 
+	int i; 
+
+	line_index_insert_rows(&E->lines, at, n); 
+	for (i = 0; i < n; i++) {
+		erow *row = line_index_get(&E->lines, at + i); 
+		char *nl = memchr(p + start, '\n', len - start); 
+		size_t end = nl != NULL ? (size_t) (nl - p) : len; 
+
+		row->chars = p + start; 
+		row->size = end - start; 
+		start = end + 1; 
+	}
+
+	editor_row_changed(at); 
+	editor_invalidate_row(at + n); 
+	E->numrows += n; 
+	E->dirty++; 
+}
+
+/**
+ * Inserts s at the cursor as it is: no auto-indent, no soft tabs. Its
+ * first line goes in the cursor row, the others become rows all at once
+ * (see editor_insert_rows()) with the rest of the cursor row after the
+ * last one, and the cursor after that. It is one record of the journal.
+ * Rows are highlighted when drawn, so only the ones in view are.
+ */
+void
+editor_insert_text(const char *s, size_t len) {
+	const char *end = s + len; 
+	const char *first = memchr(s, '\n', len); 
+	const char *last = first; 
+	const char *nl; 
+	size_t after; 
+	int tail_len; 
+	int n = 1; 
+	char *p; 
+	erow *row; 
+
+	if (E->cy > E->numrows)
+		return; 
+
+	journal_record(JOURNAL_INSERT_TEXT, E->cy, E->cx, s, len); 
+	journal_pause(); 
+	if (E->cy == E->numrows)
+		editor_insert_row(E->numrows, "", 0); 
+	row = editor_row_at(E->cy); 
+
+	if (first == NULL) {
+		editor_row_insert_bytes(row, E->cx, s, len); 
+		editor_update_row(row); 
+		E->cx += len; 
+		E->dirty++; 
+		journal_resume(); 
+		return; 
+	}
+
+	for (nl = first + 1; (nl = memchr(nl, '\n', end - nl)) != NULL; nl++) {
+		last = nl; 
+		n++; 
+	}
+
+	/* The lines after the first and the rest of the row, in one piece. */
+	editor_row_reserve(row, row->size); 
+	editor_row_close_gap(row); 
+	tail_len = row->size - E->cx; 
+	after = end - (first + 1); 
+	p = piece_add(&E->text, first + 1, after, after + tail_len + 1); 
+	if (p == NULL)
+		die("editor_insert_text"); 
+	memcpy(p + after, &ROW_CHARS(row)[E->cx], tail_len); 
+
+	if (tail_len > 0)
+		editor_row_delete_bytes(row, E->cx, tail_len); 
+	editor_row_insert_bytes(row, E->cx, s, first - s); 
+	editor_update_row(row); 
+	editor_insert_rows(E->cy + 1, p, after + tail_len, n); 
+
+	E->cy += n; 
+	E->cx = end - (last + 1); 
+	journal_resume(); 
+}
+
+/* Deletes the text from (cx, cy) to (end_cx, end_cy), such as editor_insert_text() inserted. */
+void
+editor_del_text(int cy, int cx, int end_cy, int end_cx) {
+	erow *row = editor_row_at(cy); 
+	char *tail; 
+	int tail_len; 
+	int y; 
+
+	if (row == NULL || end_cy < cy || end_cy >= E->numrows)
+		return; 
+
+	if (end_cy == cy) {
+		editor_row_delete_bytes(row, cx, end_cx - cx); 
+	} else {
+		/* What was after the text goes back to the first row. */
+		tail = editor_row_copy_tail(editor_row_at(end_cy), end_cx, &tail_len); 
+		for (y = end_cy; y > cy; y--)
+			editor_del_row(y); 
+
+		row = editor_row_at(cy); 
+		if (row->size > cx)
+			editor_row_delete_bytes(row, cx, row->size - cx); 
+		if (tail_len > 0) {
+			editor_row_insert_bytes(row, cx, tail, tail_len); 
+			free(tail); 
+		}
+	}
+
+	editor_update_row(row); 
+	E->dirty++; 
+}
+
 void
 editor_insert_char(int c) {
 	if (E->cy == E->numrows) {
@@ -301,7 +876,7 @@ editor_insert_char(int c) {
 	}
 
 	/* If soft_indent, we may insert more than one character. */
-	E->cx += editor_row_insert_char(&E->row[E->cy], E->cx, c);  
+	E->cx += editor_row_insert_char(editor_row_at(E->cy), E->cx, c);  
 }
 
 /**
@@ -324,13 +899,14 @@ calculate_indent(erow *row) {
 	int iter = 0;
 	int no_of_chars_to_indent = 0;
 	int i = 0; 
+	char *chars = ROW_CHARS(row); /* Contiguous; see editor_insert_newline(). */
 
 	if (E->is_auto_indent) {
 		iter = 1; 
 		// Cutoff point is cursor == E.cx
 		for (i = 0; iter && i < E->cx; i++) {
-			if ((row->chars[i] == ' ' && E->is_soft_indent)	
-				|| (row->chars[i] == '\t' && !E->is_soft_indent)) {
+			if ((chars[i] == ' ' && E->is_soft_indent)	
+				|| (chars[i] == '\t' && !E->is_soft_indent)) {
 				no_of_chars_to_indent++;
 			} else {
 				iter = 0;
@@ -341,13 +917,13 @@ calculate_indent(erow *row) {
 			&& (no_of_chars_to_indent % E->tab_stop == 0)) {
 
 			if (is_mode("Python")) { /* Little extra for Python mode. */
-                                no_of_chars_to_indent += is_indent(row->chars, ":\\", E->cx) * E->tab_stop;
+                                no_of_chars_to_indent += is_indent(chars, ":\\", E->cx) * E->tab_stop;
 			} else if (is_mode("Erlang")) {
-                                no_of_chars_to_indent += is_indent(row->chars, ">", E->cx) * E->tab_stop; // > not ->
+                                no_of_chars_to_indent += is_indent(chars, ">", E->cx) * E->tab_stop; // > not ->
 			} else if (is_mode("Elm")) {
-                                no_of_chars_to_indent += is_indent(row->chars, "=", E->cx) * E->tab_stop;
+                                no_of_chars_to_indent += is_indent(chars, "=", E->cx) * E->tab_stop;
 			} else if (is_mode("Bazel")) {
-                                no_of_chars_to_indent += is_indent(row->chars, "([", E->cx) * E->tab_stop;
+                                no_of_chars_to_indent += is_indent(chars, "([", E->cx) * E->tab_stop;
 			} else if (is_mode("nginx") 
                                 || is_mode("Java")
                                 || is_mode("JavaScript")
@@ -359,21 +935,21 @@ calculate_indent(erow *row) {
                                 || is_mode("Awk")
                                 || is_mode("C")
                                 || is_mode("C#")) {
-                                no_of_chars_to_indent += is_indent(row->chars, "{", E->cx) * E->tab_stop;                                
+                                no_of_chars_to_indent += is_indent(chars, "{", E->cx) * E->tab_stop;                                
                         } else if (is_mode("Kotlin")) {
-                                no_of_chars_to_indent += is_indent(row->chars, "{>", E->cx) * E->tab_stop;
+                                no_of_chars_to_indent += is_indent(chars, "{>", E->cx) * E->tab_stop;
                                 // TODO add "->": change is_indent()'s 2nd arg as char ** ("}", "->")
                         } else if (is_mode("Lua")) {
                                 // do, then, else, elseif and ) in a function row
-                                if (is_last_token(row->chars, "do") 
-                                        || is_last_token(row->chars, "then") 
-                                        || is_last_token(row->chars, "else")
-                                        || is_last_token(row->chars, "elseif")) {
+                                if (is_last_token(chars, "do") 
+                                        || is_last_token(chars, "then") 
+                                        || is_last_token(chars, "else")
+                                        || is_last_token(chars, "elseif")) {
                                         // The last character of each keyword. A hack. 
-                                        no_of_chars_to_indent += is_indent(row->chars, "onef", E->cx) * E->tab_stop; 
+                                        no_of_chars_to_indent += is_indent(chars, "onef", E->cx) * E->tab_stop; 
                                                 
-                                } else if (is_first_token(row->chars, "function")) {
-                                        no_of_chars_to_indent += is_indent(row->chars, ")", E->cx) * E->tab_stop; 
+                                } else if (is_first_token(chars, "function")) {
+                                        no_of_chars_to_indent += is_indent(chars, ")", E->cx) * E->tab_stop; 
                                 }
                         } 
 		} else if (!E->is_soft_indent
@@ -381,7 +957,7 @@ calculate_indent(erow *row) {
                         // TODO like above 
 			iter = 1; 
 			for (i = 0; iter && i < E->cx; i++) {
-				if (row->chars[i] == ':') { // target: dep
+				if (chars[i] == ':') { // target: dep
 					no_of_chars_to_indent++;
 					iter = 0;
 				} 
@@ -402,7 +978,9 @@ editor_insert_newline() {
 		editor_insert_row(E->cy, "", 0); 
 		no_of_chars_to_indent = 0; 
 	} else {
-		row = &E->row[E->cy];
+		row = editor_row_at(E->cy);
+		editor_row_reserve(row, row->size); /* The token checks need '\0'. */
+		editor_row_close_gap(row); 
 
 		no_of_chars_to_indent = calculate_indent(row);
 
@@ -412,18 +990,18 @@ editor_insert_newline() {
 			if (no_of_chars_to_indent > 0) {
 				memset(buf, E->is_soft_indent ? ' ' : '\t', no_of_chars_to_indent);
 			}
-			memcpy(&buf[no_of_chars_to_indent], &row->chars[E->cx], row->size - E->cx);
+			memcpy(&buf[no_of_chars_to_indent], &ROW_CHARS(row)[E->cx], row->size - E->cx);
 			buf[no_of_chars_to_indent + row->size - E->cx] = '\0';
 			editor_insert_row(E->cy + 1, buf, strlen(buf));
 			free(buf);
 		} else {
-			editor_insert_row(E->cy + 1, &row->chars[E->cx], row->size - E->cx); 
+			editor_insert_row(E->cy + 1, &ROW_CHARS(row)[E->cx], row->size - E->cx); 
 		}
 
 		// Update the split upper row.
-		row = &E->row[E->cy]; /* Reassign, because editor_insert_row() calls realloc(). */
-		row->size = E->cx;
-		row->chars[row->size] = '\0';
+		row = editor_row_at(E->cy); /* Reassign, because editor_insert_row() moves rows. */
+		editor_row_delete_bytes(row, E->cx, row->size - E->cx); 
+		editor_row_close_gap(row); 
 
 		editor_update_row(row);
 	}
@@ -8,23 +8,58 @@
 /** 
         row.h
         A row of text. 
-        TODO Implement a more efficient data structure. 
+        Row chars are views into the buffer's piece table (piece.h).
 */
 
+/* Smallest writable row allocated from the add buffer. */
+#define ROW_MIN_CAPACITY 16
+
+/* erow.flags; the first two are valid only while erow.gen == E->render_gen. */
+#define ROW_RENDERED (1<<0) /* render and hl (erow.r) are up to date. */
+#define ROW_HL_STATE (1<<1) /* hl_open_comment is up to date. */
+#define ROW_INLINE (1<<2) /* The chars are in erow.inl. */
+#define ROW_IS(row, flag) (((row)->flags & (flag)) && (row)->gen == E->render_gen)
+#define ROW_IS_INLINE(row) ((row)->flags & ROW_INLINE)
+
+/* The chars of a row; contiguous after editor_row_close_gap(). */
+#define ROW_CHARS(row) (ROW_IS_INLINE(row) ? (row)->inl : (row)->chars)
+#define ROW_GAP_LEN(row) ((row)->capacity > 0 ? (row)->capacity - (row)->size - 1 : 0)
+
+/* Char j of a row, skipping the gap of a row being edited. */
+#define ROW_CHAR(row, j) (ROW_IS_INLINE(row) ? (row)->inl[(j)] \
+	: (row)->chars[(j) < (row)->gap_start ? (j) : (j) + ROW_GAP_LEN(row)])
+
+/* The render of a rendered row; not '\0' terminated. */
+#define ROW_RENDER(row) ((row)->r->render != NULL ? (row)->r->render : ROW_CHARS(row))
+
+erow *editor_row_at(int at);
+int editor_row_index(erow *row);
+void editor_row_close_gap(erow *row);
 int editor_row_cx_to_rx(erow *row, int cx);
 int editor_row_rx_to_cx(erow *row, int rx);
 void editor_update_row(erow *row);
+erow *editor_row_rendered(int at);
+void editor_row_drop_render(erow *row);
+int editor_row_span_at(erow *row, int k, int rx);
+void editor_row_reserve(erow *row, int len);
 void editor_insert_row(int at, char *s, size_t len);
+void editor_insert_row_ref(int at, char *s, size_t len);
+void editor_load_rows(char *text, size_t len);
+int editor_rows_split(struct line_index *li, char *text, size_t len);
+void editor_free_render(erow *row);
 void editor_free_row(erow *row);
 void editor_del_row(int at);
 int editor_row_insert_char(erow *row, int at, char c);
 void editor_row_append_string(erow *row, char *s, size_t len);
 int editor_row_del_char(erow *row, int at);
+int editor_row_redo(int op, int at_row, int at, const char *s, int len);
 
 /** editor operations, maybe an own source file? */
 void editor_insert_char(int c);
 int calculate_indent(erow *row);
 int editor_insert_newline();
+void editor_insert_text(const char *s, size_t len);
+void editor_del_text(int cy, int cx, int end_cy, int end_cx);
 void editor_del_char(int undo); /** XXX command delete char */
 
 #endif
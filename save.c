@@ -0,0 +1,637 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "save.h"
+#include "command.h"
+#include "file.h"
+#include "gz.h"
+#include "row.h"
+#include "uring.h"
+
+/**
+        save.c
+*/
+
+/**
+ * Opens a new file next to target, with the owner and permissions of
+ * target if it exists. *tmpname is set to its name (to be freed, also
+ * on error).
+ *
+ * return the fd, -1 on error
+ */
+int
+save_open_temp(const char *target, char **tmpname) {
+        struct stat st;
+        mode_t mode;
+        int fd;
+
+        *tmpname = malloc(strlen(target) + 8);
+        if (*tmpname == NULL)
+                return -1;
+        sprintf(*tmpname, "%s.XXXXXX", target);
+
+        fd = mkstemp(*tmpname);
+        if (fd == -1)
+                return -1;
+
+        if (stat(target, &st) == 0) {
+                /* Owner first: it clears set-id bits. Others may not give files away. */
+                if (fchown(fd, st.st_uid, st.st_gid) == -1 && errno != EPERM)
+                        goto fail;
+                mode = st.st_mode & 07777;
+        } else {
+                mode_t mask = umask(0);
+                umask(mask);
+                mode = 0644 & ~mask; /* As open(2) would have made it. */
+        }
+
+        if (fchmod(fd, mode) == -1)
+                goto fail;
+
+        return fd;
+
+fail:
+        close(fd);
+        unlink(*tmpname);
+        return -1;
+}
+
+/* Flushes a saved file to the disk as far as fsync_policy says. */
+int
+save_sync(int fd) {
+        switch (fsync_policy) {
+        case FSYNC_DATA:
+                return fdatasync(fd);
+        case FSYNC_FULL:
+                return fsync(fd);
+        default:
+                return 0;
+        }
+}
+
+/* Makes the rename to target durable: syncs its directory. */
+void
+save_sync_dir(const char *target) {
+        char *dir = strdup(target);
+        char *slash;
+        int fd;
+
+        if (dir == NULL)
+                return;
+
+        slash = strrchr(dir, '/');
+        if (slash == NULL)
+                strcpy(dir, ".");
+        else if (slash == dir)
+                dir[1] = '\0';
+        else
+                *slash = '\0';
+
+        fd = open(dir, O_RDONLY | O_DIRECTORY);
+        if (fd != -1) {
+                fsync(fd);
+                close(fd);
+        }
+        free(dir);
+}
+
+/* Is row a view into the mapped file (not changed since loaded)? */
+static int
+save_is_view(erow *row) {
+        return !ROW_IS_INLINE(row) && row->capacity == 0
+                && piece_is_orig(&E->text, row->chars);
+}
+
+/**
+ * The first row to write and, in *off, where it goes in the file. The
+ * rows before it are as in the file: a view knows its offset there, and
+ * the rows after the last view were written by a save, '\n' and all.
+ */
+static int
+save_first_changed(off_t *off) {
+        int from = E->dirty_from < E->numrows ? E->dirty_from : E->numrows;
+        off_t after = 0;        /* Bytes of the rows between the view and from. */
+        int j;
+
+        for (j = from - 1; j >= 0; j--) {
+                erow *row = editor_row_at(j);
+
+                if (save_is_view(row)) {
+                        size_t start = row->chars - E->text.orig;
+                        size_t end = start + row->size;
+
+                        if (end < E->text.orig_len && E->text.orig[end] == '\n') {
+                                *off = end + 1 + after;
+                                return from;
+                        }
+
+                        /* The last line without a '\n': it gets one now. */
+                        *off = start;
+                        return j;
+                }
+                after += row->size + 1;
+        }
+
+        *off = after;
+        return from;
+}
+
+/**
+ * Can target be saved in place: is it a big file still as the rows were
+ * loaded from (and last saved to) it, with a short tail to write? If so
+ * sets j->offset and returns the first row to write, else -1.
+ */
+static int
+save_in_place_from(const char *target, struct save_job *j) {
+        struct stat st;
+        int from;
+        int k;
+
+        if (!E->text.mapped || E->text.orig_len < KILO_INCREMENTAL_SAVE_MIN_SIZE
+                || stat(target, &st) == -1
+                || st.st_dev != E->text.dev || st.st_ino != E->text.ino
+                || st.st_size != E->text.size
+                || st.st_mtim.tv_sec != E->text.mtime.tv_sec
+                || st.st_mtim.tv_nsec != E->text.mtime.tv_nsec)
+                return -1;
+
+        from = save_first_changed(&j->offset);
+        if (E->text.size - j->offset > KILO_INCREMENTAL_SAVE_MAX_TAIL)
+                return -1;
+
+        /* Views of the tail would see it change under them: copy them. */
+        for (k = from; k < E->numrows; k++) {
+                erow *row = editor_row_at(k);
+                if (save_is_view(row))
+                        editor_row_reserve(row, row->size);
+        }
+
+        return from;
+}
+
+/* Adds len bytes at base to the snapshot; joins them to the last segment if they follow it. */
+static void
+save_add(struct save_job *j, char *base, size_t len) {
+        struct iovec *last = j->nsegs > 0 ? &j->segs[j->nsegs - 1] : NULL;
+
+        j->total += len;
+        if (last != NULL && (char *) last->iov_base + last->iov_len == base) {
+                last->iov_len += len;
+                return;
+        }
+
+        if (j->nsegs == j->segs_cap) {
+                j->segs_cap = j->segs_cap ? j->segs_cap * 2 : 1024;
+                j->segs = realloc(j->segs, j->segs_cap * sizeof(struct iovec));
+                if (j->segs == NULL)
+                        die("save");
+        }
+        j->segs[j->nsegs].iov_base = base;
+        j->segs[j->nsegs++].iov_len = len;
+}
+
+/**
+ * Takes the snapshot of the rows from 'from' on. Views are shared: a run
+ * of them is one segment of the file, '\n's and all. The others are
+ * copied, each with its '\n', so they can be edited meanwhile.
+ */
+static void
+save_snapshot(struct save_job *j, int from) {
+        static char newline = '\n';
+        size_t copied = 0;
+        char *p;
+        int k;
+
+        for (k = from; k < E->numrows; k++) {
+                erow *row = editor_row_at(k);
+                if (!save_is_view(row))
+                        copied += row->size + 1;
+        }
+
+        j->copy = malloc(copied > 0 ? copied : 1);
+        if (j->copy == NULL)
+                die("save");
+        p = j->copy;
+
+        for (k = from; k < E->numrows; k++) {
+                erow *row = editor_row_at(k);
+                char *chars = ROW_CHARS(row);
+
+                if (save_is_view(row)) {
+                        size_t end = row->chars - E->text.orig + row->size;
+
+                        if (end < E->text.orig_len && E->text.orig[end] == '\n') {
+                                save_add(j, chars, row->size + 1);
+                        } else {
+                                save_add(j, chars, row->size); /* "\r\n" or none. */
+                                save_add(j, &newline, 1);
+                        }
+                        continue;
+                }
+
+                if (!ROW_IS_INLINE(row) && row->capacity > 0 && row->gap_start < row->size) {
+                        memcpy(p, chars, row->gap_start);
+                        memcpy(p + row->gap_start, chars + row->gap_start + ROW_GAP_LEN(row),
+                                row->size - row->gap_start);
+                } else {
+                        memcpy(p, chars, row->size);
+                }
+                p[row->size] = '\n';
+                save_add(j, p, row->size + 1);
+                p += row->size + 1;
+        }
+}
+
+/* Adds len to the bytes of the snapshot (j) written. */
+static void
+save_progress(void *arg, size_t len) {
+        struct save_job *j = arg;
+
+        pthread_mutex_lock(&j->lock);
+        j->written += len;
+        pthread_mutex_unlock(&j->lock);
+}
+
+/* Writes the snapshot to fd deflated. return 0 ok, -1 error */
+static int
+save_write_gzip(int fd, struct save_job *j) {
+        struct gz_writer *g = malloc(sizeof(struct gz_writer));
+        size_t done = 0;
+        int save_errno;
+        int k;
+
+        if (g == NULL || gz_writer_open(g, fd, gzip_level) == -1) {
+                free(g);
+                return -1;
+        }
+
+        for (k = 0; k < j->nsegs; k++) {
+                if (gz_writer_write(g, j->segs[k].iov_base, j->segs[k].iov_len) == -1) {
+                        save_errno = errno;
+                        gz_writer_close(g);
+                        free(g);
+                        errno = save_errno;
+                        return -1;
+                }
+
+                done += j->segs[k].iov_len;
+                if (done >= GZ_CHUNK * 16) {
+                        save_progress(j, done);
+                        done = 0;
+                }
+        }
+
+        if (gz_writer_close(g) == -1) {
+                free(g);
+                return -1;
+        }
+        j->length = g->written;
+        free(g);
+        return 0;
+}
+
+/* Writes the snapshot at the offset of fd through the ring r (see uring.h). */
+static int
+save_write_uring(struct uring *r, int fd, struct save_job *j) {
+        off_t off = lseek(fd, 0, SEEK_CUR);
+
+        if (off == -1
+                || uring_writev(r, fd, j->segs, j->nsegs, off, save_progress, j) == -1
+                || lseek(fd, off + j->total, SEEK_SET) == -1)
+                return -1;
+
+        j->length = j->total;
+        return 0;
+}
+
+/* Writes the snapshot to fd, IOV_MAX segments at a time. return 0 ok, -1 error */
+static int
+save_write(int fd, struct save_job *j) {
+        struct iovec iov[IOV_MAX];
+        struct uring ring;
+        int k;
+
+        if (j->gzip)
+                return save_write_gzip(fd, j);
+
+        /* --io uring: several writes in flight. */
+        if (uring_open(&ring) == 0) {
+                int rc = save_write_uring(&ring, fd, j);
+                int save_errno = errno;
+
+                uring_free(&ring);
+                errno = save_errno;
+                return rc;
+        }
+
+        for (k = 0; k < j->nsegs; k += IOV_MAX) {
+                int n = j->nsegs - k < IOV_MAX ? j->nsegs - k : IOV_MAX;
+                size_t len = 0;
+                int i;
+
+                /* A copy: write_all() moves it on. */
+                memcpy(iov, &j->segs[k], n * sizeof(struct iovec));
+                for (i = 0; i < n; i++)
+                        len += iov[i].iov_len;
+
+                if (write_all(fd, iov, n) == -1)
+                        return -1;
+                save_progress(j, len);
+        }
+
+        j->length = j->total;
+        return 0;
+}
+
+/**
+ * Saves to target: never in place, as a crash would leave half a file.
+ * A new file is written next to target, synced and renamed over it.
+ * Rows that are views into the mapped file stay valid, too.
+ *
+ * return 0 saved, -1 error (errno is set)
+ */
+static int
+save_atomic(struct save_job *j) {
+        char *tmpname = NULL;
+        int save_errno;
+        int fd;
+
+        fd = save_open_temp(j->target, &tmpname);
+        if (fd == -1) {
+                save_errno = errno;
+                free(tmpname);
+                errno = save_errno;
+                return -1;
+        }
+
+        if (save_write(fd, j) == -1 || save_sync(fd) == -1) {
+                save_errno = errno;
+                close(fd);
+                goto fail;
+        }
+
+        if (close(fd) == -1 || rename(tmpname, j->target) == -1) {
+                save_errno = errno;
+                goto fail;
+        }
+
+        if (fsync_policy == FSYNC_FULL)
+                save_sync_dir(j->target);
+        free(tmpname);
+        return 0;
+
+fail:
+        unlink(tmpname);
+        free(tmpname);
+        errno = save_errno;
+        return -1;
+}
+
+/* Writes the journal of an in-place save to name. */
+static int
+save_write_journal(const char *name, struct save_job *j) {
+        struct save_journal h;
+        int fd;
+
+        fd = open(name, O_RDWR | O_CREAT | O_TRUNC, 0600);
+        if (fd == -1)
+                return -1;
+
+        /* The data first; the header, written once it is on the disk, says it is whole. */
+        if (lseek(fd, sizeof(h), SEEK_SET) == -1
+                || save_write(fd, j) == -1
+                || save_sync(fd) == -1)
+                goto fail;
+
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, SAVE_JOURNAL_MAGIC, sizeof(h.magic));
+        h.dev = j->st.st_dev;
+        h.ino = j->st.st_ino;
+        h.offset = j->offset;
+        h.length = j->total;
+        if (pwrite(fd, &h, sizeof(h), 0) != sizeof(h) || save_sync(fd) == -1)
+                goto fail;
+
+        close(fd);
+        return 0;
+
+fail:
+        close(fd);
+        unlink(name);
+        return -1;
+}
+
+/* The name of the journal of target; to be freed. */
+static char *
+save_journal_name(const char *target) {
+        char *name = malloc(strlen(target) + sizeof(SAVE_JOURNAL_SUFFIX));
+
+        if (name != NULL)
+                sprintf(name, "%s%s", target, SAVE_JOURNAL_SUFFIX);
+
+        return name;
+}
+
+/**
+ * Writes the tail in place. Unless fsync_policy is FSYNC_NONE it goes
+ * to a journal first, so that a save cut short can be finished on the
+ * next open (see save_recover()).
+ *
+ * return 0 saved (j->st is of the file now), -1 error (errno is set)
+ */
+static int
+save_in_place(struct save_job *j) {
+        char *journal = NULL;
+        int fd;
+
+        if (fsync_policy != FSYNC_NONE) {
+                journal = save_journal_name(j->target);
+                if (journal == NULL || save_write_journal(journal, j) == -1) {
+                        free(journal);
+                        return -1;
+                }
+        }
+
+        /* The progress goes from 0 again. */
+        pthread_mutex_lock(&j->lock);
+        j->written = 0;
+        pthread_mutex_unlock(&j->lock);
+
+        fd = open(j->target, O_WRONLY);
+        if (fd == -1
+                || lseek(fd, j->offset, SEEK_SET) == -1
+                || save_write(fd, j) == -1
+                || ftruncate(fd, j->offset + j->total) == -1
+                || save_sync(fd) == -1
+                || fstat(fd, &j->st) == -1) {
+                int save_errno = errno;
+
+                if (fd != -1)
+                        close(fd);
+                free(journal); /* Kept: the next open finishes the save. */
+                errno = save_errno;
+                return -1;
+        }
+        close(fd);
+
+        if (journal != NULL) {
+                unlink(journal);
+                free(journal);
+        }
+
+        return 0;
+}
+
+static void *
+save_run(void *arg) {
+        struct save_job *j = arg;
+        int rc = j->in_place ? save_in_place(j) : save_atomic(j);
+        int err = errno;
+
+        pthread_mutex_lock(&j->lock);
+        j->rc = rc == 0 ? 1 : -1;
+        j->err = err;
+        j->done = 1;
+        pthread_mutex_unlock(&j->lock);
+        return NULL;
+}
+
+/**
+ * Starts saving the rows of E to target: in place if it is a big file
+ * changed only near its end, else all of them to a new file. Rows are
+ * snapshotted, so E can be edited as soon as this returns.
+ *
+ * return the save to reap with save_finish()
+ */
+struct save_job *
+save_start(const char *target) {
+        struct save_job *j = calloc(1, sizeof(struct save_job));
+        int from;
+
+        if (j == NULL || (j->target = strdup(target)) == NULL)
+                die("save");
+
+        clock_gettime(CLOCK_MONOTONIC, &j->start);
+        j->dirty_from = E->dirty_from;
+        j->changes = E->changes;
+        j->gzip = E->gzip;
+
+        from = save_in_place_from(target, j);
+        if (from != -1) {
+                j->in_place = 1;
+                j->st.st_dev = E->text.dev; /* For the journal. */
+                j->st.st_ino = E->text.ino;
+        }
+        save_snapshot(j, from != -1 ? from : 0);
+
+        pthread_mutex_init(&j->lock, NULL);
+        if (pthread_create(&j->thread, NULL, save_run, j) != 0)
+                die("save thread");
+
+        return j;
+}
+
+/* Is the save over (to be reaped with save_finish())? */
+int
+save_done(struct save_job *j) {
+        int done;
+
+        pthread_mutex_lock(&j->lock);
+        done = j->done;
+        pthread_mutex_unlock(&j->lock);
+
+        return done;
+}
+
+/* How much of the snapshot is written. */
+int
+save_percent(struct save_job *j) {
+        size_t written;
+
+        pthread_mutex_lock(&j->lock);
+        written = j->written;
+        pthread_mutex_unlock(&j->lock);
+
+        return j->total > 0 ? (int) (100.0 * written / j->total) : 100;
+}
+
+/**
+ * Waits for the save to be over.
+ *
+ * return 1 saved (j->length bytes), -1 error (errno is set)
+ */
+int
+save_finish(struct save_job *j) {
+        pthread_join(j->thread, NULL);
+        errno = j->err;
+        return j->rc;
+}
+
+void
+save_free(struct save_job *j) {
+        pthread_mutex_destroy(&j->lock);
+        free(j->segs);
+        free(j->copy);
+        free(j->target);
+        free(j);
+}
+
+/**
+ * Finishes a save of filename cut short (see save_incremental()): the
+ * journal, if whole, is written to the file again.
+ *
+ * return 1 finished, 0 there was none, -1 error
+ */
+int
+save_recover(const char *filename) {
+        struct save_journal h;
+        struct stat st, jst;
+        char buf[64 * 1024];
+        char *journal = save_journal_name(filename);
+        off_t done = 0;
+        int rc = 0;
+        int jfd;
+        int fd;
+
+        if (journal == NULL)
+                return 0;
+
+        jfd = open(journal, O_RDONLY);
+        if (jfd == -1) {
+                free(journal);
+                return 0;
+        }
+
+        /* A journal cut short itself was not acted on: the file is as it was. */
+        if (fstat(jfd, &jst) == 0 && read(jfd, &h, sizeof(h)) == sizeof(h)
+                && memcmp(h.magic, SAVE_JOURNAL_MAGIC, sizeof(h.magic)) == 0
+                && (uint64_t) jst.st_size == sizeof(h) + h.length
+                && stat(filename, &st) == 0
+                && (uint64_t) st.st_dev == h.dev && (uint64_t) st.st_ino == h.ino) {
+                rc = -1;
+                fd = open(filename, O_WRONLY);
+                if (fd != -1) {
+                        ssize_t n;
+
+                        while ((n = read(jfd, buf, sizeof(buf))) > 0
+                                && pwrite(fd, buf, n, h.offset + done) == n)
+                                done += n;
+
+                        if ((uint64_t) done == h.length
+                                && ftruncate(fd, h.offset + h.length) == 0
+                                && fsync(fd) == 0)
+                                rc = 1;
+                        close(fd);
+                }
+        }
+
+        close(jfd);
+        if (rc != -1)
+                unlink(journal);
+        free(journal);
+
+        return rc;
+}
@@ -0,0 +1,84 @@
+#ifndef SAVE_H
+#define SAVE_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/**
+        save.h
+
+        Writing a buffer to its file. A save normally writes a new file
+        next to the old one and renames it over (see editor_save()).
+
+        A big file that was only changed near its end is instead written
+        in place, from the first changed row on (E->dirty_from): the rows
+        before it are not written at all. A journal of the new tail makes
+        this safe against crashes too (see save_recover()).
+
+        Either way the file is written by a thread, so that editing can
+        go on meanwhile. save_start() takes a snapshot of the rows first:
+        rows that are views into the file are immutable and shared, the
+        bytes of the others are copied. The main thread reaps the save
+        with save_finish() once save_done() says it is over.
+*/
+
+#define SAVE_JOURNAL_SUFFIX ".kilo-save"
+#define SAVE_JOURNAL_MAGIC "KILOSAV1"
+
+/* The journal: this header, then the length bytes to write at offset. */
+struct save_journal {
+        char magic[8];
+        uint64_t dev;
+        uint64_t ino;
+        uint64_t offset;
+        uint64_t length;        /* The file ends after these. */
+};
+
+struct save_job {
+        pthread_t thread;
+        pthread_mutex_t lock;
+
+        /* The snapshot: what to write. Read-only while the thread runs. */
+        struct iovec *segs;
+        int nsegs;
+        int segs_cap;
+        char *copy;             /* The bytes of the rows that are not views. */
+        size_t total;
+        char *target;
+        int in_place;           /* At offset, else a new file renamed over target. */
+        int gzip;               /* Deflated on the way (never in place). */
+        off_t offset;
+
+        /* The caller's, see editor_save(). */
+        int command_key;
+        int partial;            /* The rows saved of a stream still read, else 0. */
+        int dirty_from;         /* E->dirty_from when the snapshot was taken. */
+        unsigned long changes;  /* E->changes then. */
+        struct timespec start;
+
+        /* Shared, under lock. */
+        size_t written;
+        int done;
+
+        /* Set by the thread when done. */
+        int rc;                 /* 1 saved, -1 error (in err). */
+        size_t length;          /* The bytes written to the file. */
+        int err;
+        struct stat st;         /* Of target after an in-place save. */
+};
+
+int save_open_temp(const char *target, char **tmpname);
+int save_sync(int fd);
+void save_sync_dir(const char *target);
+struct save_job *save_start(const char *target);
+int save_done(struct save_job *j);
+int save_percent(struct save_job *j);
+int save_finish(struct save_job *j);
+void save_free(struct save_job *j);
+int save_recover(const char *filename);
+
+#endif
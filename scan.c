@@ -0,0 +1,161 @@
+#include <pthread.h>
+#include <string.h>
+#include "scan.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+/**
+        scan.c
+
+        Compares 16 (SSE2) or 32 (AVX2) bytes at a time against '\n' and
+        turns the resulting bit mask into line end offsets. AVX2 is used
+        if the CPU has it. Other machines, and the tail of a block, use
+        memchr().
+*/
+
+static size_t
+count_scalar(const char *s, size_t len) {
+        const char *end = s + len;
+        size_t n = 0;
+
+        while (s < end && (s = memchr(s, '\n', end - s)) != NULL) {
+                s++;
+                n++;
+        }
+
+        return n;
+}
+
+static size_t
+find_scalar(const char *s, size_t len, size_t i, size_t *pos, size_t n, size_t max, size_t *scanned) {
+        while (i < len && n < max) {
+                const char *p = memchr(s + i, '\n', len - i);
+                if (p == NULL) {
+                        i = len;
+                        break;
+                }
+                pos[n++] = p - s;
+                i = p - s + 1;
+        }
+
+        *scanned = i;
+        return n;
+}
+
+#ifdef SCAN_X86
+
+static size_t
+count_sse2(const char *s, size_t len) {
+        const __m128i nl = _mm_set1_epi8('\n');
+        size_t i = 0;
+        size_t n = 0;
+
+        for (; i + 16 <= len; i += 16) {
+                __m128i v = _mm_loadu_si128((const __m128i *) (s + i));
+                n += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl)));
+        }
+
+        return n + count_scalar(s + i, len - i);
+}
+
+static size_t
+find_sse2(const char *s, size_t len, size_t *pos, size_t max, size_t *scanned) {
+        const __m128i nl = _mm_set1_epi8('\n');
+        size_t i = 0;
+        size_t n = 0;
+
+        /* Stop while there is room for a full block of hits. */
+        for (; i + 16 <= len && n + 16 <= max; i += 16) {
+                __m128i v = _mm_loadu_si128((const __m128i *) (s + i));
+                unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, nl));
+
+                while (mask != 0) {
+                        pos[n++] = i + __builtin_ctz(mask);
+                        mask &= mask - 1;
+                }
+        }
+
+        return find_scalar(s, len, i, pos, n, max, scanned);
+}
+
+__attribute__((target("avx2,popcnt")))
+static size_t
+count_avx2(const char *s, size_t len) {
+        const __m256i nl = _mm256_set1_epi8('\n');
+        size_t i = 0;
+        size_t n = 0;
+
+        for (; i + 32 <= len; i += 32) {
+                __m256i v = _mm256_loadu_si256((const __m256i *) (s + i));
+                n += __builtin_popcount(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl)));
+        }
+
+        return n + count_scalar(s + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t
+find_avx2(const char *s, size_t len, size_t *pos, size_t max, size_t *scanned) {
+        const __m256i nl = _mm256_set1_epi8('\n');
+        size_t i = 0;
+        size_t n = 0;
+
+        for (; i + 32 <= len && n + 32 <= max; i += 32) {
+                __m256i v = _mm256_loadu_si256((const __m256i *) (s + i));
+                unsigned int mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl));
+
+                while (mask != 0) {
+                        pos[n++] = i + __builtin_ctz(mask);
+                        mask &= mask - 1;
+                }
+        }
+
+        return find_scalar(s, len, i, pos, n, max, scanned);
+}
+
+static pthread_once_t avx2_once = PTHREAD_ONCE_INIT;
+static int avx2;
+
+static void
+detect_avx2() {
+        __builtin_cpu_init();
+        avx2 = __builtin_cpu_supports("avx2");
+}
+
+/* Files are scanned on several threads (see loader.h, opener.h). */
+static int
+has_avx2() {
+        pthread_once(&avx2_once, detect_avx2);
+        return avx2;
+}
+
+#endif
+
+/* The number of '\n' in s (len bytes). */
+size_t
+scan_count_lines(const char *s, size_t len) {
+#ifdef SCAN_X86
+        return has_avx2() ? count_avx2(s, len) : count_sse2(s, len);
+#else
+        return count_scalar(s, len);
+#endif
+}
+
+/**
+ * Stores the offsets of (at most max) '\n's in s (len bytes) to pos.
+ * *scanned is set to the bytes looked at: go on from s + *scanned.
+ *
+ * return the number of offsets stored
+ */
+size_t
+scan_find_lines(const char *s, size_t len, size_t *pos, size_t max, size_t *scanned) {
+#ifdef SCAN_X86
+        return has_avx2() ? find_avx2(s, len, pos, max, scanned)
+                : find_sse2(s, len, pos, max, scanned);
+#else
+        return find_scalar(s, len, 0, pos, 0, max, scanned);
+#endif
+}
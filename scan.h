@@ -0,0 +1,15 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+
+/**
+        scan.h
+
+        Finding the line ends ('\n') of a loaded file in bulk.
+*/
+
+size_t scan_count_lines(const char *s, size_t len);
+size_t scan_find_lines(const char *s, size_t len, size_t *pos, size_t max, size_t *scanned);
+
+#endif
@@ -0,0 +1,425 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "screen.h"
+#include "output.h"
+
+/**
+        screen.c
+
+        The terminal is assumed to be as screen_flush() left it: cursor
+        at (cy, cx), default attributes. Anything else writing to it has
+        to call screen_invalidate().
+*/
+
+/* Cell x of a row, the bytes at bc/ba in the back and fc/fa in the front. */
+#define CELL_BLANK(x) (bc[x] == ' ' && ba[x] == 0)
+#define CELL_SAME(x) (bc[x] == fc[x] && ba[x] == fa[x])
+
+/* The SGR sequences to each attribute: from the default ones, and from the same reversal. */
+static struct {
+        char all[16];
+        char fg[8];
+        unsigned char all_len;
+        unsigned char fg_len;
+} sgr[CELL_ATTRS];
+
+static void
+screen_sgr_init() {
+        int attr;
+
+        for (attr = 0; attr < CELL_ATTRS; attr++) {
+                int fg = attr & CELL_FG_MASK;
+                int len;
+
+                len = snprintf(sgr[attr].all, sizeof(sgr[attr].all), "\x1b[0%s", (attr & CELL_REVERSE) ? ";7" : "");
+                if (fg)
+                        len += snprintf(sgr[attr].all + len, sizeof(sgr[attr].all) - len, ";%d", fg + 29);
+                sgr[attr].all[len++] = 'm';
+                sgr[attr].all_len = len;
+                sgr[attr].fg_len = snprintf(sgr[attr].fg, sizeof(sgr[attr].fg), "\x1b[%dm", fg ? fg + 29 : 39);
+        }
+}
+
+static void
+grid_alloc(struct grid *g, size_t n) {
+        free(g->ch);
+        free(g->attr);
+        g->ch = malloc(n);
+        g->attr = malloc(n);
+        if (g->ch == NULL || g->attr == NULL)
+                die("screen");
+}
+
+static void
+grid_clear(struct grid *g, size_t n) {
+        memset(g->ch, ' ', n);
+        memset(g->attr, 0, n);
+}
+
+/* Starts a frame of rows x cols blank cells; after a resize the whole screen is written. */
+void
+screen_begin(int rows, int cols) {
+        size_t n;
+
+        if (rows < 1)
+                rows = 1;
+        if (cols < 1)
+                cols = 1;
+        n = (size_t) rows * cols;
+
+        if (SCREEN.wide == NULL)
+                screen_sgr_init();
+
+        if (SCREEN.wide == NULL || rows != SCREEN.rows || cols != SCREEN.cols) {
+                grid_alloc(&SCREEN.front, n);
+                grid_alloc(&SCREEN.back, n);
+                free(SCREEN.wide);
+                free(SCREEN.end);
+                free(SCREEN.front_end);
+                SCREEN.wide = malloc(rows);
+                SCREEN.end = malloc(rows * sizeof(int));
+                SCREEN.front_end = malloc(rows * sizeof(int));
+                if (SCREEN.wide == NULL || SCREEN.end == NULL || SCREEN.front_end == NULL)
+                        die("screen");
+                SCREEN.rows = rows;
+                SCREEN.cols = cols;
+                SCREEN.valid = 0;
+        }
+
+        grid_clear(&SCREEN.back, n);
+        memset(SCREEN.end, 0, rows * sizeof(int));
+}
+
+/* Draws the len bytes of s from (y, x) on, as far as the row goes. */
+void
+screen_put(int y, int x, const char *s, int len, int attr) {
+        size_t i = (size_t) y * SCREEN.cols + x;
+
+        if (y < 0 || y >= SCREEN.rows || x < 0)
+                return;
+        if (len > SCREEN.cols - x)
+                len = SCREEN.cols - x;
+        if (len <= 0)
+                return;
+
+        memcpy(SCREEN.back.ch + i, s, len);
+        memset(SCREEN.back.attr + i, attr, len);
+        if (x + len > SCREEN.end[y])
+                SCREEN.end[y] = x + len;
+}
+
+/* Draws n times ch from (y, x) on. */
+void
+screen_fill(int y, int x, int ch, int n, int attr) {
+        size_t i = (size_t) y * SCREEN.cols + x;
+
+        if (y < 0 || y >= SCREEN.rows || x < 0)
+                return;
+        if (n > SCREEN.cols - x)
+                n = SCREEN.cols - x;
+        if (n <= 0)
+                return;
+
+        memset(SCREEN.back.ch + i, ch, n);
+        memset(SCREEN.back.attr + i, attr, n);
+        if (x + n > SCREEN.end[y])
+                SCREEN.end[y] = x + n;
+}
+
+/**
+ * Rows [top, bottom[ of the next frame are those of the last one moved
+ * up by n (down if n < 0), as when the file is scrolled.
+ */
+void
+screen_scroll(int top, int bottom, int n) {
+        SCREEN.scroll = n;
+        SCREEN.scroll_top = top;
+        SCREEN.scroll_bottom = bottom;
+}
+
+/* The next frame is written whole, on a cleared terminal. */
+void
+screen_invalidate() {
+        SCREEN.valid = 0;
+}
+
+static void
+screen_move(struct abuf *ab, int y, int x) {
+        char buf[32];
+        int len;
+
+        if (SCREEN.cy == y && SCREEN.cx == x)
+                return;
+
+        if (SCREEN.cy == y && SCREEN.cx != -1 && x > SCREEN.cx)
+                len = snprintf(buf, sizeof(buf), "\x1b[%dC", x - SCREEN.cx);
+        else
+                len = snprintf(buf, sizeof(buf), "\x1b[%d;%dH", y + 1, x + 1);
+
+        ab_append(ab, buf, len);
+        SCREEN.cy = y;
+        SCREEN.cx = x;
+}
+
+/* Sets the attributes of what is written next; *current is the terminal's. */
+static void
+screen_attr(struct abuf *ab, int attr, int *current) {
+        if (attr == *current)
+                return;
+
+        if ((attr & CELL_REVERSE) == (*current & CELL_REVERSE))
+                ab_append(ab, sgr[attr].fg, sgr[attr].fg_len); /* Only the colour changes. */
+        else
+                ab_append(ab, sgr[attr].all, sgr[attr].all_len);
+        *current = attr;
+}
+
+/* Writes the cells [from, to[ of row y, a run of the same attributes at a time. */
+static void
+screen_write(struct abuf *ab, int y, int from, int to, int *attr) {
+        unsigned char *ch = SCREEN.back.ch + (size_t) y * SCREEN.cols;
+        unsigned char *at = SCREEN.back.attr + (size_t) y * SCREEN.cols;
+        int x;
+        int end;
+
+        screen_move(ab, y, from);
+        for (x = from; x < to; x = end) {
+                for (end = x + 1; end < to && at[end] == at[x]; end++)
+                        ;
+                screen_attr(ab, at[x], attr);
+                ab_append(ab, (char *) ch + x, end - x);
+        }
+
+        /* At the last column the terminal is about to wrap: where it is is not known. */
+        SCREEN.cx = to < SCREEN.cols ? to : -1;
+        if (SCREEN.cx == -1)
+                SCREEN.cy = -1;
+}
+
+/* Whether the n bytes at s have bytes of multibyte UTF-8 characters, which are not columns. */
+static int
+screen_is_wide(const unsigned char *s, int n) {
+        uint64_t high = 0;
+        uint64_t w;
+        int i;
+
+        /* A word at a time. */
+        for (i = 0; i + 8 <= n; i += 8) {
+                memcpy(&w, s + i, 8);
+                high |= w;
+        }
+        for (; i < n; i++)
+                high |= s[i];
+        return (high & 0x8080808080808080ULL) != 0;
+}
+
+/* Writes what differs in row y from the front; return 1 if anything */
+static int
+screen_row(struct abuf *ab, int y, int *attr) {
+        size_t o = (size_t) y * SCREEN.cols;
+        unsigned char *bc = SCREEN.back.ch + o;
+        unsigned char *ba = SCREEN.back.attr + o;
+        unsigned char *fc = SCREEN.front.ch + o;
+        unsigned char *fa = SCREEN.front.attr + o;
+        int tail = SCREEN.end[y];       /* The row is blank from here on. */
+        int last;                       /* Nothing changed from here on. */
+        int x = 0;
+        int wide;
+
+        while (tail > 0 && CELL_BLANK(tail - 1))
+                tail--;
+        SCREEN.end[y] = tail;
+
+        /* Past both ends the front and the back are blank. Most rows have not changed. */
+        last = tail > SCREEN.front_end[y] ? tail : SCREEN.front_end[y];
+        if (memcmp(bc, fc, last) == 0 && memcmp(ba, fa, last) == 0)
+                return 0;
+        while (CELL_SAME(last - 1))
+                last--;
+
+        wide = screen_is_wide(bc, tail);
+        if (wide || SCREEN.wide[y]) {
+                /* Bytes are not columns in this row: it is written whole. */
+                SCREEN.wide[y] = wide;
+                screen_write(ab, y, 0, tail, attr);
+                screen_attr(ab, 0, attr);
+                ab_append(ab, "\x1b[K", 3);
+                SCREEN.cy = SCREEN.cx = -1;
+                return 1;
+        }
+
+        while (x < last) {
+                int start;
+                int end;
+                int gap = 0;
+
+                if (CELL_SAME(x)) {
+                        x++;
+                        continue;
+                }
+
+                /* A run of changed cells, with short gaps of unchanged ones. */
+                start = end = x;
+                for (x++; x < last; x++) {
+                        if (!CELL_SAME(x)) {
+                                end = x;
+                                gap = 0;
+                        } else if (++gap > SCREEN_GAP_MAX) {
+                                break;
+                        }
+                }
+
+                if (end < tail) {
+                        screen_write(ab, y, start, end + 1, attr);
+                        continue;
+                }
+
+                /* Into the blank end of the row: erased, with all of it. */
+                if (start < tail)
+                        screen_write(ab, y, start, tail, attr);
+                else
+                        screen_move(ab, y, start);
+                if (SCREEN.cy == -1)
+                        screen_move(ab, y, tail);
+                screen_attr(ab, 0, attr);
+                ab_append(ab, "\x1b[K", 3);
+                break;
+        }
+
+        return 1;
+}
+
+/* Row y of the back is the same as row z of the front. */
+static int
+screen_row_same(int y, int z) {
+        size_t b = (size_t) y * SCREEN.cols;
+        size_t f = (size_t) z * SCREEN.cols;
+
+        return memcmp(SCREEN.back.ch + b, SCREEN.front.ch + f, SCREEN.cols) == 0
+                && memcmp(SCREEN.back.attr + b, SCREEN.front.attr + f, SCREEN.cols) == 0;
+}
+
+/**
+ * Moves the rows of the terminal as screen_scroll() said, if more of
+ * them then end up where they are in the back grid than stay where they
+ * are. The front grid is moved the same way, with blank rows coming in.
+ */
+static void
+screen_shift(struct abuf *ab) {
+        int top = SCREEN.scroll_top;
+        int bottom = SCREEN.scroll_bottom;
+        int n = SCREEN.scroll;
+        int height = bottom - top;
+        int cols = SCREEN.cols;
+        int moved = 0;
+        int stayed = 0;
+        int from;
+        int to;
+        int y;
+        char buf[48];
+        int len;
+
+        SCREEN.scroll = 0;
+        if (n == 0 || top < 0 || bottom > SCREEN.rows || abs(n) >= height)
+                return;
+
+        for (y = top; y < bottom; y++) {
+                if (y + n >= top && y + n < bottom && screen_row_same(y, y + n))
+                        moved++;
+                if (screen_row_same(y, y))
+                        stayed++;
+        }
+        if (moved <= stayed)
+                return;
+
+        /* The region, moved in it, and the region back to the whole screen (which homes the cursor). */
+        len = snprintf(buf, sizeof(buf), "\x1b[%d;%dr\x1b[%d%c\x1b[r",
+                top + 1, bottom, abs(n), n > 0 ? 'S' : 'T');
+        ab_append(ab, buf, len);
+        SCREEN.cy = SCREEN.cx = -1;
+
+        from = n > 0 ? top + n : top;
+        to = n > 0 ? top : top - n;
+        memmove(SCREEN.front.ch + (size_t) to * cols, SCREEN.front.ch + (size_t) from * cols,
+                (size_t) (height - abs(n)) * cols);
+        memmove(SCREEN.front.attr + (size_t) to * cols, SCREEN.front.attr + (size_t) from * cols,
+                (size_t) (height - abs(n)) * cols);
+        memmove(SCREEN.front_end + to, SCREEN.front_end + from, (height - abs(n)) * sizeof(int));
+        memmove(SCREEN.wide + to, SCREEN.wide + from, height - abs(n));
+
+        /* In at the bottom (top). */
+        from = n > 0 ? bottom - n : top;
+        memset(SCREEN.front.ch + (size_t) from * cols, ' ', (size_t) abs(n) * cols);
+        memset(SCREEN.front.attr + (size_t) from * cols, 0, (size_t) abs(n) * cols);
+        memset(SCREEN.front_end + from, 0, abs(n) * sizeof(int));
+        memset(SCREEN.wide + from, 0, abs(n));
+}
+
+/**
+ * Writes what changed since the last frame and puts the cursor at
+ * (cy, cx). The back grid becomes the front one.
+ */
+void
+screen_flush(int cy, int cx) {
+        static struct abuf ab = ABUF_INIT;     /* Kept from frame to frame. */
+        struct grid g;
+        int *end;
+        int attr = 0;           /* The terminal's. */
+        int drawn = 0;
+        int skip = 6;           /* The cursor is not hidden if nothing is drawn. */
+        int y;
+
+        ab.len = 0;
+        ab_append(&ab, "\x1b[?25l", 6);
+
+        if (!SCREEN.valid) {
+                /* Cleared: the front is blank. */
+                ab_append(&ab, "\x1b[m\x1b[2J", 7);
+                grid_clear(&SCREEN.front, (size_t) SCREEN.rows * SCREEN.cols);
+                memset(SCREEN.front_end, 0, SCREEN.rows * sizeof(int));
+                memset(SCREEN.wide, 0, SCREEN.rows);
+                SCREEN.cy = SCREEN.cx = -1;
+                SCREEN.valid = 1;
+                SCREEN.scroll = 0;
+                drawn = 1;
+        }
+
+        if (SCREEN.scroll != 0) {
+                int len = ab.len;
+
+                screen_shift(&ab);
+                drawn |= ab.len > len;
+        }
+
+        for (y = 0; y < SCREEN.rows; y++)
+                drawn |= screen_row(&ab, y, &attr);
+        screen_attr(&ab, 0, &attr);
+
+        if (cy >= SCREEN.rows)
+                cy = SCREEN.rows - 1;
+        if (cx >= SCREEN.cols)
+                cx = SCREEN.cols - 1;
+        screen_move(&ab, cy, cx);
+        if (drawn) {
+                ab_append(&ab, "\x1b[?25h", 6);
+                skip = 0;
+        }
+
+        if (ab.len > skip)
+                write(STDOUT_FILENO, ab.b + skip, ab.len - skip);
+
+        SCREEN.frames++;
+        SCREEN.last_bytes = ab.len - skip;
+        SCREEN.bytes += SCREEN.last_bytes;
+
+        /* The back is drawn over from scratch: the grids are swapped. */
+        g = SCREEN.front;
+        SCREEN.front = SCREEN.back;
+        SCREEN.back = g;
+        end = SCREEN.front_end;
+        SCREEN.front_end = SCREEN.end;
+        SCREEN.end = end;
+}
@@ -0,0 +1,66 @@
+#ifndef SCREEN_H
+#define SCREEN_H
+
+#include <stddef.h>
+
+/**
+        screen.h
+
+        What is on the terminal, cell by cell. A frame is drawn into the
+        back grid (see editor_refresh_screen()); screen_flush() compares it
+        with the front grid, which is what the terminal shows, and writes
+        only the runs of cells that changed, with the cursor moved over
+        the rest. Typing a character usually costs a few dozen bytes, not
+        a screenful.
+
+        Scrolling by a few rows (screen_scroll()) moves what is on the
+        terminal with a scroll region, and only the rows that come into
+        view are written.
+*/
+
+/* The attributes of a cell: a foreground colour (0 = default), reversed or not. */
+#define CELL_FG(colour) ((colour) - 29)         /* SGR 30-37 to 1-8. */
+#define CELL_FG_MASK 0x0f
+#define CELL_REVERSE 0x10
+#define CELL_ATTRS 0x20
+
+/* Changed cells this close to each other are written over, not skipped by moving the cursor. */
+#define SCREEN_GAP_MAX 4
+
+/* A grid of cells, with the bytes and the attributes apart so that runs are copied whole. */
+struct grid {
+        unsigned char *ch;
+        unsigned char *attr;
+};
+
+struct screen {
+        struct grid front;      /* On the terminal. */
+        struct grid back;       /* The frame being drawn. */
+        int *end;               /* Per row of back: blank from here on, or before. */
+        int *front_end;
+        unsigned char *wide;    /* Per row of front: has bytes of multibyte characters. */
+        int rows;
+        int cols;
+        int valid;              /* 0: front is not known, the terminal is cleared first. */
+        int cy;                 /* Where the terminal cursor is, -1 not known. */
+        int cx;
+        int scroll;             /* Rows [scroll_top, scroll_bottom[ moved up (down if < 0) by this much. */
+        int scroll_top;
+        int scroll_bottom;
+
+        /* --debug 64: what the frames cost. */
+        long frames;
+        size_t bytes;           /* Written in all. */
+        size_t last_bytes;      /* By the last frame. */
+};
+
+struct screen SCREEN;
+
+void screen_begin(int rows, int cols);
+void screen_put(int y, int x, const char *s, int len, int attr);
+void screen_fill(int y, int x, int ch, int n, int attr);
+void screen_scroll(int top, int bottom, int n);
+void screen_flush(int cy, int cx);
+void screen_invalidate();
+
+#endif
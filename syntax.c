@@ -20,12 +20,23 @@ is_separator(char c) {
 	return isspace(c) || c == '\0' || strchr(",.(){}+-/*=~%<>[];:", c) != NULL;
 }
 
+/* Does s (len chars) start at render[i]? render is not '\0' terminated. */
+static int
+syntax_match(char *render, int rsize, int i, char *s, int len) {
+	return i + len <= rsize && !strncmp(&render[i], s, len); 
+}
+
+/**
+ * Highlights render (rsize chars) of row into hl, one byte per column.
+ * Sets row->hl_open_comment.
+ */
 void
-syntax_update(erow *row) {
+syntax_update(erow *row, char *render, int rsize, unsigned char *hl) {
 	int i = 0; 
 	int prev_sep = 1; 
 	int in_string = 0; 
-	int in_comment = 0; //(row->idx > 0 && E.row[row->idx - 1].hl_open_comment); 
+	int in_comment = 0; 
+	int idx; 
 	char prev_char = '\0'; /* JK */
 	char *scs; 
 	char *mcs;
@@ -34,15 +45,20 @@ syntax_update(erow *row) {
 	int mce_len; 
 	int scs_len; 
 	char **keywords; // = E.syntax->keywords; 
-	int changed; 
 
-	row->hl = realloc(row->hl, row->rsize);
-	memset(row->hl, HL_NORMAL, row->rsize);
+	memset(hl, HL_NORMAL, rsize);
 
-	if (E->syntax == NULL)
+	if (E->syntax == NULL) {
+		row->hl_open_comment = 0; 
 		return; 
+	}
 
-	in_comment = (row->idx > 0 && E->row[row->idx - 1].hl_open_comment); 
+	idx = editor_row_index(row); 
+	/* A page of a view starts from the state kept for it, without the page before. */
+	if (E->view.active && idx % VIEW_PAGE_LINES == 0)
+		in_comment = view_state_at(&E->view, idx, E->syntax->filetype); 
+	else
+		in_comment = (idx > 0 && editor_row_at(idx - 1)->hl_open_comment); 
 
 	keywords = E->syntax->keywords; 
 
@@ -54,13 +70,13 @@ syntax_update(erow *row) {
 	mcs_len = mcs ? strlen(mcs) : 0; 
 	mce_len = mce ? strlen(mce) : 0; 
 
-	while (i < row->rsize) {
-		char c = row->render[i];
-		unsigned char prev_hl = (i > 0) ? row->hl[i - 1] : HL_NORMAL;
+	while (i < rsize) {
+		char c = render[i];
+		unsigned char prev_hl = (i > 0) ? hl[i - 1] : HL_NORMAL;
 
 		if (scs_len && !in_string && !in_comment) {
-			if (!strncmp(&row->render[i], scs, scs_len)) {
-				memset(&row->hl[i], HL_COMMENT, row->rsize - i); 
+			if (syntax_match(render, rsize, i, scs, scs_len)) {
+				memset(&hl[i], HL_COMMENT, rsize - i); 
 				break; 
 			}
 		}
@@ -68,9 +84,9 @@ syntax_update(erow *row) {
 		/* multiline comment end found while in mlcomment */
 		if (mcs_len && mce_len && !in_string) {
 			if (in_comment) {
-				row->hl[i] = HL_MLCOMMENT;
-				if (!strncmp(&row->render[i], mce, mce_len)) {
-					memset(&row->hl[i], HL_MLCOMMENT, mce_len);
+				hl[i] = HL_MLCOMMENT;
+				if (syntax_match(render, rsize, i, mce, mce_len)) {
+					memset(&hl[i], HL_MLCOMMENT, mce_len);
 					i += mce_len;
 					in_comment = 0;
 					prev_sep = 1;
@@ -79,8 +95,8 @@ syntax_update(erow *row) {
 					i++; 
 					continue; 
 				}
-			} else if (!strncmp(&row->render[i], mcs, mcs_len)) {
-				memset(&row->hl[i], HL_MLCOMMENT, mcs_len);
+			} else if (syntax_match(render, rsize, i, mcs, mcs_len)) {
+				memset(&hl[i], HL_MLCOMMENT, mcs_len);
 				i += mcs_len;
 				in_comment = 1; 
 				continue; 
@@ -89,10 +105,10 @@ syntax_update(erow *row) {
 
 		if (E->syntax->flags & HL_HIGHLIGHT_STRINGS) {
 			if (in_string) {
-				row->hl[i] = HL_STRING;
+				hl[i] = HL_STRING;
 
-				if (c == '\\' && i+ 1 < row->rsize) {
-					row->hl[i + 1] = HL_STRING; 
+				if (c == '\\' && i+ 1 < rsize) {
+					hl[i + 1] = HL_STRING; 
 					i += 2; 
 					continue; 
 				}
@@ -105,7 +121,7 @@ syntax_update(erow *row) {
 			} else {
 				if (c == '"' || c == '\'') {
 					in_string = c; 
-					row->hl[i] = HL_STRING; 
+					hl[i] = HL_STRING; 
 					i++; 
 					continue; 
 
@@ -116,7 +132,7 @@ syntax_update(erow *row) {
 		if (E->syntax->flags & HL_HIGHLIGHT_NUMBERS) {
 			if ((isdigit(c) && (prev_sep || prev_hl == HL_NUMBER)) 
 					|| (c == '.' && prev_hl == HL_NUMBER)) {
-				row->hl[i] = HL_NUMBER; 
+				hl[i] = HL_NUMBER; 
 				i++;
 				prev_sep = 0;
 				prev_char = c; 
@@ -133,9 +149,9 @@ syntax_update(erow *row) {
 				if (is_keyword2) 
 					klen--;
 
-				if (!strncmp(&row->render[i], keywords[j], klen)
-					&& is_separator(row->render[i + klen])) {
-					memset(&row->hl[i], is_keyword2 ? HL_KEYWORD2 : HL_KEYWORD1, klen);
+				if (syntax_match(render, rsize, i, keywords[j], klen)
+					&& is_separator(i + klen < rsize ? render[i + klen] : '\0')) {
+					memset(&hl[i], is_keyword2 ? HL_KEYWORD2 : HL_KEYWORD1, klen);
 					i += klen;
 					break;
 				}
@@ -149,17 +165,24 @@ syntax_update(erow *row) {
 		prev_sep = is_separator(c);
 
 		if (isspace(c) && i > 0 && prev_char == '.' && prev_hl == HL_NUMBER)
-			row->hl[i - 1] = HL_NORMAL; /* Denormalize sentence ending colon. */
+			hl[i - 1] = HL_NORMAL; /* Denormalize sentence ending colon. */
 		prev_char = c; 
 			
 		i++;
 	}
 
-	changed = (row->hl_open_comment != in_comment); 
+	/* editor_render_row() takes care of the next row if this changed. */
 	row->hl_open_comment = in_comment; 
-	if (changed && row->idx + 1 < E->numrows) {
-		syntax_update(&E->row[row->idx + 1]);
-	}
+	if (E->view.active && (idx + 1) % VIEW_PAGE_LINES == 0)
+		view_set_state_after(&E->view, idx, in_comment, E->syntax->filetype); 
+}
+
+/* Does the mode have multiline comments, ie. do rows depend on the previous ones? */
+int
+syntax_is_multiline() {
+	return E->syntax != NULL 
+		&& E->syntax->multiline_comment_start != NULL && E->syntax->multiline_comment_start[0] != '\0'
+		&& E->syntax->multiline_comment_end != NULL && E->syntax->multiline_comment_end[0] != '\0';
 }
 
 int
@@ -181,16 +204,12 @@ syntax_to_colour(int hl) {
 */
 void 
 syntax_set(struct editor_syntax *syntax) {
-	int filerow; 
-
 	E->syntax = syntax; 
 	E->tab_stop = E->syntax->tab_stop; // TODO refactor E->tab_stop away
 	E->is_soft_indent = ! (E->syntax->flags & HARD_TABS); 
 	E->is_auto_indent = E->syntax->is_auto_indent;
 
-	for (filerow = 0; filerow < E->numrows; filerow++) {
-		syntax_update(&E->row[filerow]); 
-	}
+	E->render_gen++; /* Rows are highlighted again when drawn. */
 }
 
 char *
@@ -244,6 +263,7 @@ syntax_select_highlight(char *mode, int silent) {
 	//int mode_found = 0; 
 	char *p = NULL ;
 	E->syntax = NULL;
+	E->render_gen++;
 
 	if (E->filename == NULL && mode == NULL)
 		return 1;  
@@ -7,7 +7,8 @@
 #include "filetypes.h"
 
 int is_separator(char c);
-void syntax_update(erow *row);
+void syntax_update(erow *row, char *render, int rsize, unsigned char *hl);
+int syntax_is_multiline();
 int syntax_to_colour(int hl);
 void syntax_set(struct editor_syntax *syntax);
 int is_syntax_mode_set(); // a wrapper for E->syntax != NULL
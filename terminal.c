@@ -1,3 +1,4 @@
+#include <fcntl.h>
 #include "terminal.h"
 
 /**
@@ -15,6 +16,7 @@ die(const char *s) {
 
 void 
 disable_raw_mode() {
+	write(STDOUT_FILENO, "\x1b[?2004l", 8); /* Bracketed paste off. */
 	if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &TERMINAL.orig_termios) == -1)
 		die("tcsetattr");
 }
@@ -40,6 +42,32 @@ enable_raw_mode() {
 
 	if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == -1)
 		die ("tcsetattr");
+
+	/* Pastes come between ESC [ 200 ~ and ESC [ 201 ~ (see key_read()). */
+	write(STDOUT_FILENO, "\x1b[?2004h", 8); 
+}
+
+/**
+ * Piped input (cmd | kilo) is not the keyboard: it is moved to another
+ * fd, and the keys are read from /dev/tty in its place.
+ *
+ * return the fd of the piped input, -1 if stdin is the terminal
+ */
+int
+terminal_take_stdin() {
+	int fd; 
+	int tty; 
+
+	if (isatty(STDIN_FILENO))
+		return -1; 
+
+	fd = dup(STDIN_FILENO); 
+	tty = open("/dev/tty", O_RDWR); 
+	if (fd == -1 || tty == -1 || dup2(tty, STDIN_FILENO) == -1)
+		die("/dev/tty"); 
+	close(tty); 
+
+	return fd; 
 }
 
 int 
@@ -25,6 +25,7 @@ struct term_config TERMINAL;
 void die(const char *s);
 void disable_raw_mode();
 void enable_raw_mode();
+int terminal_take_stdin();
 int get_cursor_position(int *rows, int *cols);
 int get_window_size(int *rows, int *cols);
 
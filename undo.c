@@ -17,6 +17,8 @@ init_undo_stack(int default_command) {
 	undo_stack->cx = 0;
 	undo_stack->cy = 0; 
 	undo_stack->orig_value = 0;
+	undo_stack->end_cx = 0;
+	undo_stack->end_cy = 0;
 	undo_stack->clipboard = NULL; 
 	undo_stack->next = NULL; 
 
@@ -64,6 +66,8 @@ alloc_and_init_undo(int command_key) {
 	undo->cx = E->cx;
 	undo->cy = E->cy; 
 	undo->command_key = command_key; 
+	undo->end_cx = 0; 
+	undo->end_cy = 0; 
         undo->clipboard = NULL; 
 	undo->next = current_buffer->undo_stack;
 	current_buffer->undo_stack = undo; 
@@ -131,6 +135,7 @@ undo() {
 		break;
 	case COMMAND_SET_TAB_STOP:
 		E->tab_stop = top->orig_value;
+		E->render_gen++;
 		break;
 	case COMMAND_SET_HARD_TABS:
 		E->is_soft_indent = 0;
@@ -157,6 +162,13 @@ undo() {
 			editor_del_char(1);
 		break; 
 		}
+	case COMMAND_DELETE_PASTE:
+		editor_del_text(top->cy, top->cx, top->end_cy, top->end_cx); 
+		if (top->orig_value == 1)
+			editor_del_row(top->cy); 
+		E->cx = top->cx; 
+		E->cy = top->cy; 
+		break; 
 	case COMMAND_YANK_CLIPBOARD:
 		undo_clipboard_kill_lines(top->clipboard);
 		free(top->clipboard->row);
@@ -11,7 +11,9 @@ struct undo_str {
 	int undo_command_key; // undo command (if need to be run)
 	int cx; 
 	int cy;
-	int orig_value; // set-tabs, auto-indent
+	int orig_value; // set-tabs, auto-indent; paste: 1 if it made its first row
+	int end_cx; // paste: where the pasted text ends
+	int end_cy; 
 	struct clipboard *clipboard; // kill, yank
 	struct undo_str *next; // Because of stack.
 };
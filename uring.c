@@ -0,0 +1,436 @@
+#define _GNU_SOURCE /* IOV_MAX */
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "uring.h"
+
+/**
+        uring.c
+
+        One ring per call (or reader), used by one thread: the loader, the
+        save writer or the main thread. Requests carry their slot (one of
+        URING_DEPTH) as user_data, as they may complete in any order.
+*/
+
+static void
+uring_push(struct uring *r, int op, int fd, const void *addr, unsigned len, off_t off, unsigned slot) {
+        unsigned tail = *r->sq_tail;
+        unsigned i = tail & *r->sq_mask;
+        struct io_uring_sqe *sqe = &r->sqes[i];
+
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = op;
+        sqe->fd = fd;
+        sqe->addr = (unsigned long) addr;
+        sqe->len = len;
+        sqe->off = off;
+        sqe->user_data = slot;
+        r->sq_array[i] = i;
+
+        /* The kernel sees the entry once the tail is past it. */
+        __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+        r->queued++;
+}
+
+/**
+ * Submits what is queued and waits for a completion.
+ * return 0 (slot and res set), -1 error (errno is set)
+ */
+static int
+uring_reap(struct uring *r, unsigned *slot, int *res) {
+        for (;;) {
+                unsigned head = *r->cq_head;
+                int min = 0;
+                int n;
+
+                if (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE) && r->queued == 0) {
+                        struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+
+                        *slot = cqe->user_data;
+                        *res = cqe->res;
+                        __atomic_store_n(r->cq_head, head + 1, __ATOMIC_RELEASE);
+                        return 0;
+                }
+
+                if (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE))
+                        min = 1;
+                n = syscall(__NR_io_uring_enter, r->fd, r->queued, min,
+                        min ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+                if (n == -1 && errno != EINTR)
+                        return -1;
+                if (n > 0)
+                        r->queued -= n;
+        }
+}
+
+/**
+ * Sets up a ring, if --io uring and the kernel allows.
+ * return 0 ok, -1 not to be used (plain I/O then)
+ */
+int
+uring_open(struct uring *r) {
+        struct io_uring_params p;
+        int save_errno;
+
+        memset(r, 0, sizeof(*r));
+        r->fd = -1;
+        if (io_backend != IO_URING) {
+                errno = ENOSYS;
+                return -1;
+        }
+
+        memset(&p, 0, sizeof(p));
+        r->fd = syscall(__NR_io_uring_setup, URING_DEPTH, &p);
+        if (r->fd == -1)
+                return -1;
+
+        r->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        r->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+        if ((p.features & IORING_FEAT_SINGLE_MMAP) && r->cq_ring_size > r->sq_ring_size)
+                r->sq_ring_size = r->cq_ring_size;
+
+        r->sq_ring = mmap(NULL, r->sq_ring_size, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+        if (r->sq_ring == MAP_FAILED) {
+                r->sq_ring = NULL;
+                goto fail;
+        }
+
+        if (p.features & IORING_FEAT_SINGLE_MMAP) {
+                r->cq_ring = r->sq_ring;
+        } else {
+                r->cq_ring = mmap(NULL, r->cq_ring_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+                if (r->cq_ring == MAP_FAILED) {
+                        r->cq_ring = NULL;
+                        goto fail;
+                }
+        }
+
+        r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+        r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+        if (r->sqes == MAP_FAILED) {
+                r->sqes = NULL;
+                goto fail;
+        }
+
+        r->sq_tail = (unsigned *) ((char *) r->sq_ring + p.sq_off.tail);
+        r->sq_mask = (unsigned *) ((char *) r->sq_ring + p.sq_off.ring_mask);
+        r->sq_array = (unsigned *) ((char *) r->sq_ring + p.sq_off.array);
+        r->cq_head = (unsigned *) ((char *) r->cq_ring + p.cq_off.head);
+        r->cq_tail = (unsigned *) ((char *) r->cq_ring + p.cq_off.tail);
+        r->cq_mask = (unsigned *) ((char *) r->cq_ring + p.cq_off.ring_mask);
+        r->cqes = (struct io_uring_cqe *) ((char *) r->cq_ring + p.cq_off.cqes);
+        return 0;
+
+fail:
+        save_errno = errno;
+        uring_free(r);
+        errno = save_errno;
+        return -1;
+}
+
+/* Nothing may be in flight. */
+void
+uring_free(struct uring *r) {
+        if (r->sqes != NULL)
+                munmap(r->sqes, r->sqes_size);
+        if (r->cq_ring != NULL && r->cq_ring != r->sq_ring)
+                munmap(r->cq_ring, r->cq_ring_size);
+        if (r->sq_ring != NULL)
+                munmap(r->sq_ring, r->sq_ring_size);
+        if (r->fd != -1)
+                close(r->fd);
+        memset(r, 0, sizeof(*r));
+        r->fd = -1;
+}
+
+/* Reads len bytes at off, or up to the end of the file. return bytes read, -1 error */
+static ssize_t
+pread_all(int fd, char *buf, size_t len, off_t off) {
+        size_t total = 0;
+
+        while (total < len) {
+                ssize_t n = pread(fd, buf + total, len - total, off + total);
+
+                if (n == -1 && errno == EINTR)
+                        continue;
+                if (n == -1)
+                        return -1;
+                if (n == 0)
+                        break;
+                total += n;
+        }
+
+        return total;
+}
+
+static int
+pwrite_all(int fd, const char *buf, size_t len, off_t off) {
+        while (len > 0) {
+                ssize_t n = pwrite(fd, buf, len, off);
+
+                if (n == -1 && errno == EINTR)
+                        continue;
+                if (n == -1)
+                        return -1;
+                buf += n;
+                len -= n;
+                off += n;
+        }
+
+        return 0;
+}
+
+/**
+ * Reads len bytes of fd at off into buf, URING_CHUNK at a time with
+ * URING_DEPTH in flight. From the first read failed or cut short on,
+ * plain pread() takes over (and finds the end of the file, if that was it).
+ *
+ * return the bytes read (fewer than len at the end of the file), -1 error
+ */
+ssize_t
+uring_read(struct uring *r, int fd, char *buf, size_t len, off_t off) {
+        size_t at[URING_DEPTH];
+        size_t size[URING_DEPTH];
+        unsigned free_slots[URING_DEPTH];
+        unsigned nfree = URING_DEPTH;
+        unsigned inflight = 0;
+        size_t next = 0;
+        size_t resume = len;    /* Where pread() takes over. */
+        ssize_t n;
+        unsigned i;
+
+        for (i = 0; i < URING_DEPTH; i++)
+                free_slots[i] = i;
+
+        while (inflight > 0 || next < resume) {
+                unsigned slot;
+                int res;
+
+                while (nfree > 0 && next < resume) {
+                        slot = free_slots[--nfree];
+                        at[slot] = next;
+                        size[slot] = len - next < URING_CHUNK ? len - next : URING_CHUNK;
+                        uring_push(r, IORING_OP_READ, fd, buf + next, size[slot], off + next, slot);
+                        next += size[slot];
+                        inflight++;
+                }
+
+                if (uring_reap(r, &slot, &res) == -1)
+                        return -1; /* The ring itself failed: it is not used again. */
+                inflight--;
+                free_slots[nfree++] = slot;
+
+                if ((size_t) res != size[slot] && at[slot] + (res > 0 ? res : 0) < resume)
+                        resume = at[slot] + (res > 0 ? res : 0);
+        }
+
+        if (resume == len)
+                return len;
+
+        n = pread_all(fd, buf + resume, len - resume, off + resume);
+        return n == -1 ? -1 : (ssize_t) resume + n;
+}
+
+/* Writes the rest, after done bytes, of the n iovecs at off. */
+static int
+pwritev_rest(int fd, const struct iovec *iov, int n, off_t off, size_t done) {
+        int i;
+
+        for (i = 0; i < n; i++) {
+                if (done >= iov[i].iov_len) {
+                        done -= iov[i].iov_len;
+                } else {
+                        if (pwrite_all(fd, (char *) iov[i].iov_base + done,
+                                iov[i].iov_len - done, off + done) == -1)
+                                return -1;
+                        done = 0;
+                }
+                off += iov[i].iov_len;
+        }
+
+        return 0;
+}
+
+/**
+ * Writes the n iovecs (kept by the caller until done) to fd at off,
+ * about URING_CHUNK at a time with URING_DEPTH in flight. A write failed
+ * or cut short is done again with pwrite(); progress is told of every
+ * chunk written.
+ *
+ * return 0 ok, -1 error (errno is set)
+ */
+int
+uring_writev(struct uring *r, int fd, const struct iovec *iov, int n, off_t off,
+        void (*progress)(void *arg, size_t n), void *arg) {
+        int first[URING_DEPTH];
+        int count[URING_DEPTH];
+        off_t at[URING_DEPTH];
+        size_t size[URING_DEPTH];
+        unsigned free_slots[URING_DEPTH];
+        unsigned nfree = URING_DEPTH;
+        unsigned inflight = 0;
+        int next = 0;
+        int err = 0;
+        unsigned i;
+
+        for (i = 0; i < URING_DEPTH; i++)
+                free_slots[i] = i;
+
+        while (inflight > 0 || (next < n && err == 0)) {
+                unsigned slot;
+                int res;
+
+                while (nfree > 0 && next < n && err == 0) {
+                        slot = free_slots[--nfree];
+                        first[slot] = next;
+                        count[slot] = 0;
+                        at[slot] = off;
+                        size[slot] = 0;
+                        do {
+                                size[slot] += iov[next++].iov_len;
+                                count[slot]++;
+                        } while (next < n && count[slot] < IOV_MAX && size[slot] < URING_CHUNK);
+
+                        uring_push(r, IORING_OP_WRITEV, fd, &iov[first[slot]], count[slot], at[slot], slot);
+                        off += size[slot];
+                        inflight++;
+                }
+
+                if (uring_reap(r, &slot, &res) == -1)
+                        return -1;
+                inflight--;
+                free_slots[nfree++] = slot;
+
+                if ((size_t) res != size[slot] && err == 0
+                        && pwritev_rest(fd, &iov[first[slot]], count[slot], at[slot], res > 0 ? res : 0) == -1)
+                        err = errno;
+                if (err == 0)
+                        progress(arg, size[slot]);
+        }
+
+        if (err != 0) {
+                errno = err;
+                return -1;
+        }
+
+        return 0;
+}
+
+/* Asks for the chunk to go in slot. */
+static void
+uring_reader_submit(struct uring_reader *rd, unsigned slot) {
+        uring_push(&rd->ring, IORING_OP_READ, rd->fd, rd->bufs + (size_t) slot * URING_READ_CHUNK,
+                URING_READ_CHUNK, rd->next, slot);
+        rd->next += URING_READ_CHUNK;
+        rd->ready[slot] = 0;
+        rd->inflight++;
+}
+
+/* Waits for what is in flight. return 0 ok, -1 the ring failed */
+static int
+uring_reader_drain(struct uring_reader *rd) {
+        while (rd->inflight > 0) {
+                unsigned slot;
+                int res;
+
+                if (uring_reap(&rd->ring, &slot, &res) == -1)
+                        return -1;
+                rd->res[slot] = res;
+                rd->ready[slot] = 1;
+                rd->inflight--;
+        }
+
+        return 0;
+}
+
+/**
+ * Starts reading fd from off on: URING_DEPTH chunks are asked for at
+ * once. Without a ring the chunks are read one by one as asked for.
+ *
+ * return 0 ok, -1 error
+ */
+int
+uring_reader_open(struct uring_reader *rd, int fd, off_t off) {
+        unsigned i;
+
+        memset(rd, 0, sizeof(*rd));
+        rd->fd = fd;
+        rd->off = off;
+        rd->next = off;
+        rd->lent = -1;
+        rd->bufs = malloc((size_t) URING_DEPTH * URING_READ_CHUNK);
+        if (rd->bufs == NULL)
+                return -1;
+
+        if (uring_open(&rd->ring) == 0)
+                for (i = 0; i < URING_DEPTH; i++)
+                        uring_reader_submit(rd, i);
+
+        return 0;
+}
+
+/**
+ * The next chunk of the file, in *buf until the next call.
+ * return its size, 0 at the end of the file, -1 error
+ */
+ssize_t
+uring_reader_next(struct uring_reader *rd, char **buf) {
+        unsigned slot = rd->head;
+        ssize_t n;
+
+        if (rd->ring.fd != -1) {
+                /* The chunk before is done with: its buffer takes the next one. */
+                if (rd->lent != -1)
+                        uring_reader_submit(rd, rd->lent);
+                rd->lent = -1;
+
+                while (!rd->ready[slot]) {
+                        unsigned done;
+                        int res;
+
+                        if (uring_reap(&rd->ring, &done, &res) == -1)
+                                return -1;
+                        rd->res[done] = res;
+                        rd->ready[done] = 1;
+                        rd->inflight--;
+                }
+
+                n = rd->res[slot];
+                if (n != URING_READ_CHUNK) {
+                        /* The end, or a read failed or cut short: pread() from here on. */
+                        if (uring_reader_drain(rd) == -1)
+                                return -1;
+                        uring_free(&rd->ring);
+                        if (n <= 0)
+                                return uring_reader_next(rd, buf);
+                }
+
+                rd->head = (slot + 1) % URING_DEPTH;
+                rd->lent = slot;
+                rd->off += n;
+                *buf = rd->bufs + (size_t) slot * URING_READ_CHUNK;
+                return n;
+        }
+
+        n = pread_all(rd->fd, rd->bufs, URING_READ_CHUNK, rd->off);
+        if (n > 0)
+                rd->off += n;
+        *buf = rd->bufs;
+        return n;
+}
+
+void
+uring_reader_close(struct uring_reader *rd) {
+        if (rd->ring.fd != -1) {
+                uring_reader_drain(rd);
+                uring_free(&rd->ring);
+        }
+        free(rd->bufs);
+}
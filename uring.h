@@ -0,0 +1,73 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include "const.h"
+
+/**
+        uring.h
+
+        Bulk file I/O through io_uring (--io uring), with a few large reads
+        or writes in flight at a time, so that a loaded disk is kept busy
+        while the caller inflates or waits. No liburing: the rings are set
+        up with the raw system calls.
+
+        It is optional. uring_open() fails if it is not asked for or the
+        kernel does not have it (or forbids it, as some containers do),
+        and the callers go on with plain read() and write(). A request the
+        kernel fails or cuts short is done with those too.
+*/
+
+/* Requests in flight at a time, and the most bytes in one. */
+#define URING_DEPTH 8
+#define URING_CHUNK (1024 * 1024)
+/* What uring_reader_next() hands out at a time. */
+#define URING_READ_CHUNK (256 * 1024)
+
+int io_backend; /* --io: IO_SYNC or IO_URING (see const.h). */
+
+struct uring {
+        int fd;                 /* -1: none, plain read() and write(). */
+        unsigned *sq_tail;
+        unsigned *sq_mask;
+        unsigned *sq_array;
+        struct io_uring_sqe *sqes;
+        unsigned *cq_head;
+        unsigned *cq_tail;
+        unsigned *cq_mask;
+        struct io_uring_cqe *cqes;
+        void *sq_ring;
+        void *cq_ring;          /* Or sq_ring, if the kernel maps them as one. */
+        size_t sq_ring_size;
+        size_t cq_ring_size;
+        size_t sqes_size;
+        unsigned queued;        /* Not submitted yet. */
+};
+
+/* A file read in order, URING_DEPTH chunks ahead of the caller. */
+struct uring_reader {
+        struct uring ring;
+        int fd;
+        off_t off;              /* Of the next chunk handed out. */
+        off_t next;             /* Of the next chunk to submit. */
+        char *bufs;             /* URING_DEPTH chunks. */
+        ssize_t res[URING_DEPTH];
+        int ready[URING_DEPTH];
+        unsigned head;          /* The chunk handed out next (mod URING_DEPTH). */
+        int lent;               /* The slot handed out last, -1 none. */
+        unsigned inflight;
+};
+
+int uring_open(struct uring *r);
+void uring_free(struct uring *r);
+ssize_t uring_read(struct uring *r, int fd, char *buf, size_t len, off_t off);
+int uring_writev(struct uring *r, int fd, const struct iovec *iov, int n, off_t off,
+        void (*progress)(void *arg, size_t n), void *arg);
+int uring_reader_open(struct uring_reader *rd, int fd, off_t off);
+ssize_t uring_reader_next(struct uring_reader *rd, char **buf);
+void uring_reader_close(struct uring_reader *rd);
+
+#endif
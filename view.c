@@ -0,0 +1,302 @@
+#include <stdlib.h>
+#include <string.h>
+#include "view.h"
+#include "row.h"
+#include "terminal.h"
+#include "scan.h"
+
+#define VIEW_SCAN_BATCH 1024
+
+/**
+        view.c
+*/
+
+void
+view_init(struct line_view *v) {
+        int i;
+
+        v->active = 0;
+        v->text = NULL;
+        v->len = 0;
+        v->checkpoints = NULL;
+        v->states = NULL;
+        v->states_mode = NULL;
+        v->ncheckpoints = 0;
+        v->numrows = 0;
+        v->clock = 0;
+        memset(&v->cache, 0, sizeof(struct line_cache));
+        v->cached = 0;
+        for (i = 0; i < VIEW_PAGES; i++) {
+                v->pages[i].first = -1;
+                v->pages[i].count = 0;
+                v->pages[i].used = 0;
+                v->pages[i].known = 0;
+                v->pages[i].rows = NULL;
+        }
+}
+
+/* Gives back render and hl of the rows of page p. */
+static void
+view_drop_page(struct view_page *p) {
+        int i;
+
+        for (i = 0; i < p->count; i++)
+                editor_free_render(&p->rows[i]);
+        p->first = -1;
+        p->count = 0;
+}
+
+void
+view_free(struct line_view *v) {
+        int i;
+
+        for (i = 0; i < VIEW_PAGES; i++) {
+                if (v->pages[i].rows != NULL)
+                        view_drop_page(&v->pages[i]);
+                free(v->pages[i].rows);
+        }
+        if (v->cache.map != NULL) {
+                line_cache_close(&v->cache);
+        } else {
+                free(v->checkpoints);
+                free(v->states);
+        }
+        view_init(v);
+}
+
+/* The line starting at p (< end): its length without the end of line. */
+static size_t
+view_line(char *p, char *end, char **next) {
+        char *nl = memchr(p, '\n', end - p);
+        size_t len = (nl != NULL ? nl + 1 : end) - p;
+
+        *next = p + len;
+        if (len > 0 && (p[len - 1] == '\n' || p[len - 1] == '\r'))
+                len--;
+
+        return len;
+}
+
+/* Takes the checkpoints and states from the (open) cache. */
+static void
+view_use_cache(struct line_view *v) {
+        v->checkpoints = v->cache.checkpoints;
+        v->states = v->cache.states;
+        v->states_mode = v->cache.header->mode;
+        v->ncheckpoints = v->cache.header->ncheckpoints;
+        v->numrows = v->cache.header->numrows;
+}
+
+/**
+ * Scans text (len bytes, kept by the caller) for the checkpoints.
+ * Lines are split as in command_open_file(). If filename (absolute, 
+ * stat'ed to st) is given the sidecar is read instead, if it is good, 
+ * or written for next time.
+ *
+ * return 0 ok, -1 out of memory
+ */
+int
+view_open(struct line_view *v, char *text, size_t len, const char *filename, struct stat *st) {
+        size_t pos[VIEW_SCAN_BATCH];
+        size_t off = 0;
+        size_t start = 0;       /* Of the next line. */
+        size_t scanned;
+        size_t found;
+        size_t k;
+        int capacity = 0;
+
+        view_free(v);
+        v->text = text;
+        v->len = len;
+
+        if (filename != NULL && line_cache_open(&v->cache, filename, st, len, VIEW_PAGE_LINES) == 0) {
+                view_use_cache(v);
+                v->cached = 1;
+                v->active = 1;
+                return 0;
+        }
+
+        while (start < len) {
+                found = scan_find_lines(text + off, len - off, pos, VIEW_SCAN_BATCH, &scanned);
+                if (found == 0)
+                        pos[found++] = len - off - 1;
+
+                for (k = 0; k < found; k++) {
+                        if (v->numrows % VIEW_PAGE_LINES == 0) {
+                                if (v->ncheckpoints == capacity) {
+                                        capacity = capacity ? capacity * 2 : 64;
+                                        v->checkpoints = realloc(v->checkpoints, capacity * sizeof(size_t));
+                                        if (v->checkpoints == NULL)
+                                                return -1;
+                                }
+                                v->checkpoints[v->ncheckpoints++] = start;
+                        }
+                        start = off + pos[k] + 1;
+                        v->numrows++;
+                }
+                off += scanned;
+        }
+
+        if (filename != NULL 
+                && line_cache_save(filename, st, len, VIEW_PAGE_LINES, v->checkpoints, v->ncheckpoints, v->numrows) == 0
+                && line_cache_open(&v->cache, filename, st, len, VIEW_PAGE_LINES) == 0) {
+                free(v->checkpoints);
+                view_use_cache(v);
+        } else {
+                v->states = malloc(v->ncheckpoints > 0 ? v->ncheckpoints : 1);
+                if (v->states == NULL)
+                        return -1;
+                memset(v->states, CACHE_STATE_UNKNOWN, v->ncheckpoints);
+                v->mode_buf[0] = '\0';
+                v->states_mode = v->mode_buf;
+        }
+
+        v->active = 1;
+        return 0;
+}
+
+/* Makes the rows of page k (lines k * VIEW_PAGE_LINES...) into p. */
+static void
+view_load_page(struct line_view *v, struct view_page *p, int k) {
+        char *s = v->text + v->checkpoints[k];
+        char *end = v->text + v->len;
+        int i;
+
+        if (p->rows == NULL) {
+                p->rows = malloc(VIEW_PAGE_LINES * sizeof(erow));
+                if (p->rows == NULL)
+                        die("view_load_page");
+        }
+
+        p->first = k * VIEW_PAGE_LINES;
+        p->count = v->numrows - p->first;
+        if (p->count > VIEW_PAGE_LINES)
+                p->count = VIEW_PAGE_LINES;
+
+        memset(p->rows, 0, p->count * sizeof(erow));
+        for (i = 0; i < p->count; i++) {
+                p->rows[i].chars = s;
+                p->rows[i].size = view_line(s, end, &s);
+        }
+}
+
+/**
+ * The row at line 'at' or NULL. The row stays valid until VIEW_PAGES
+ * other pages have been asked for.
+ */
+erow *
+view_row_at(struct line_view *v, int at) {
+        struct view_page *lru;
+        int k = at / VIEW_PAGE_LINES;
+        int i;
+
+        if (at < 0 || at >= v->numrows)
+                return NULL;
+
+        v->clock++;
+        lru = &v->pages[0];
+        for (i = 0; i < VIEW_PAGES; i++) {
+                struct view_page *p = &v->pages[i];
+                if (p->first == k * VIEW_PAGE_LINES) {
+                        p->used = v->clock;
+                        return &p->rows[at - p->first];
+                }
+                if (p->used < lru->used)
+                        lru = p;
+        }
+
+        view_drop_page(lru);
+        view_load_page(v, lru, k);
+        lru->known = 0;
+        lru->used = v->clock;
+        return &lru->rows[at - lru->first];
+}
+
+/* The line number of row (from view_row_at()). */
+int
+view_row_number(struct line_view *v, erow *row) {
+        int i;
+
+        for (i = 0; i < VIEW_PAGES; i++) {
+                struct view_page *p = &v->pages[i];
+                if (p->first != -1 && row >= p->rows && row < p->rows + p->count)
+                        return p->first + (row - p->rows);
+        }
+
+        return -1;
+}
+
+/* The loaded page with line at, or NULL. */
+static struct view_page *
+view_page_of(struct line_view *v, int at) {
+        int i;
+
+        for (i = 0; i < VIEW_PAGES; i++) {
+                struct view_page *p = &v->pages[i];
+                if (p->first != -1 && at >= p->first && at < p->first + p->count)
+                        return p;
+        }
+
+        return NULL;
+}
+
+/* States found in another mode are of no use: forget them. */
+static void
+view_check_mode(struct line_view *v, const char *mode) {
+        int i;
+
+        if (strncmp(v->states_mode, mode, CACHE_MODE_LEN - 1) == 0)
+                return;
+
+        memset(v->states, CACHE_STATE_UNKNOWN, v->ncheckpoints);
+        strncpy(v->states_mode, mode, CACHE_MODE_LEN - 1);
+        v->states_mode[CACHE_MODE_LEN - 1] = '\0';
+        for (i = 0; i < VIEW_PAGES; i++)
+                v->pages[i].known = 0;
+}
+
+/**
+ * The multiline comment state (in mode) before line at, the first of a
+ * page, as it is being highlighted. If it is not known, the last row of
+ * the page before tells, if that page is loaded; else it is taken to be
+ * out of a comment: a page is not loaded only for that.
+ *
+ * return 0 or 1
+ */
+int
+view_state_at(struct line_view *v, int at, const char *mode) {
+        struct view_page *p = view_page_of(v, at);
+        struct view_page *prev;
+        int k = at / VIEW_PAGE_LINES;
+        int state;
+
+        view_check_mode(v, mode);
+        if (k == 0)
+                state = 0;
+        else
+                state = v->states[k] == CACHE_STATE_UNKNOWN ? -1 : v->states[k];
+
+        if (p != NULL)
+                p->known = state != -1;
+
+        if (state == -1) {
+                prev = view_page_of(v, at - 1);
+                state = prev != NULL && prev->rows[at - 1 - prev->first].hl_open_comment;
+        }
+
+        return state;
+}
+
+/**
+ * Records the state after line at, the last of a page, for the next 
+ * page. Only if the state its page started from was known.
+ */
+void
+view_set_state_after(struct line_view *v, int at, int state, const char *mode) {
+        struct view_page *p = view_page_of(v, at);
+        int k = at / VIEW_PAGE_LINES + 1;
+
+        view_check_mode(v, mode);
+        if (p != NULL && p->known && k < v->ncheckpoints)
+                v->states[k] = state;
+}
@@ -0,0 +1,61 @@
+#ifndef VIEW_H
+#define VIEW_H
+
+#include <stddef.h>
+#include <sys/stat.h>
+#include "cache.h"
+
+/**
+        view.h
+
+        Rows of a read-only buffer (BUFFER_TYPE_READONLY) for files too
+        big to keep a row per line. The file is scanned once for the
+        offset of every VIEW_PAGE_LINES'th line; rows are made, as views
+        into the text, a page at a time when asked for, and only the
+        VIEW_PAGES pages used last are kept. Memory stays bounded by the
+        number of pages plus one offset per VIEW_PAGE_LINES lines.
+
+        For files of KILO_CACHE_MIN_SIZE and up the checkpoints are kept
+        in a sidecar (see cache.h) and read from there next time. So is
+        the multiline comment state at the start of each page, once
+        found: a page is then highlighted without the one above it.
+*/
+
+#define VIEW_PAGE_LINES 1024
+#define VIEW_PAGES 8
+
+struct erow;
+
+struct view_page {
+        int first;              /* Line number of rows[0]; -1 = unused. */
+        int count;
+        unsigned long used;     /* view.clock when last asked for. */
+        int known;              /* The state at rows[0] was known when highlighted. */
+        struct erow *rows;
+};
+
+struct line_view {
+        int active;
+        char *text;
+        size_t len;
+        size_t *checkpoints;    /* Offset of line k * VIEW_PAGE_LINES. */
+        unsigned char *states;  /* In a comment at checkpoint k, or CACHE_STATE_UNKNOWN. */
+        char *states_mode;      /* The mode the states are for. */
+        char mode_buf[CACHE_MODE_LEN];
+        int ncheckpoints;
+        int numrows;
+        struct line_cache cache; /* Holds the above if cached. */
+        int cached;             /* The checkpoints came from the cache. */
+        unsigned long clock;
+        struct view_page pages[VIEW_PAGES];
+};
+
+void view_init(struct line_view *v);
+void view_free(struct line_view *v);
+int view_open(struct line_view *v, char *text, size_t len, const char *filename, struct stat *st);
+struct erow *view_row_at(struct line_view *v, int at);
+int view_row_number(struct line_view *v, struct erow *row);
+int view_state_at(struct line_view *v, int at, const char *mode);
+void view_set_state_after(struct line_view *v, int at, int state, const char *mode);
+
+#endif